@@ -16,159 +16,839 @@
 #include <algorithm>
 #include "board.h"
 #include "action.h"
+#include "solver.h"
+#include "pool.h"
+#include "cache.h"
+#include "book.h"
+#include "pattern.h"
+#include "mobility.h"
+#include "bitboard.h"
+#include "isa.h"
 #include <fstream>
 #include <ctime>
+#include <chrono>
+#include <functional>
+#include <atomic>
+#include <cstdio>
+#include <unistd.h>
+
+/**
+ * adaptive playout policy, whose tables are shared by all iterations of a search
+ *
+ * MAST (move-average sampling technique) keeps the average reward of each move of each side,
+ * and a playout tries the moves in Gibbs-sampled order, i.e., moves with higher averages first
+ * LGRF (last-good-reply with forgetting) remembers the winning reply to each previous move,
+ * which is tried before anything else, and forgets the reply once it loses
+ * with pattern weights, a playout samples every move in proportion to the weight of its 3x3 pattern
+ * with eval > 0, a leaf is valued by the static mobility evaluation mixed with weight eval into the
+ * playout result, and eval = 1 skips the playout
+ * a leaf may be valued by several playouts, which run one after another or at once on a pool
+ */
+class playout_policy {
+public:
+	enum mode { random = 0u, mast = 1u, lgrf = 2u, pattern = 4u };
+
+	playout_policy(unsigned flags = mode::random, float tau = 1, const pattern_weights* weights = nullptr, float eval = 0)
+		: flags(weights ? flags | mode::pattern : flags & ~mode::pattern), tau(tau), weights(weights),
+		  eval(std::min(std::max(eval, 0.0f), 1.0f)), leaf(1), workers(nullptr) {
+		for (auto& side : stat) side.fill({0, 0});
+		for (auto& side : reply) side.fill(-1);
+	}
+
+public:
+	/**
+	 * get the move order of a playout for the given side
+	 * all moves are shuffled; with MAST, they are then sorted by the Gumbel-perturbed averages,
+	 * so that the first legal move follows the softmax distribution of the averages
+	 */
+	std::vector<int> order(unsigned who, std::default_random_engine& engine) const {
+		std::vector<int> moves(board::size_x * board::size_y);
+		for (size_t i = 0; i < moves.size(); i++) moves[i] = i;
+		std::shuffle(moves.begin(), moves.end(), engine);
+		if (flags & mode::mast) {
+			std::uniform_real_distribution<float> uniform(1e-6, 1);
+			std::array<float, board::size_x * board::size_y> key;
+			for (int move : moves) {
+				const record& rec = stat[who - 1][move];
+				float average = (rec.win + 1) / (rec.visit + 2);
+				key[move] = average / tau - std::log(-std::log(uniform(engine)));
+			}
+			std::stable_sort(moves.begin(), moves.end(), [&](int a, int b) { return key[a] > key[b]; });
+		}
+		return moves;
+	}
+
+	/**
+	 * get the remembered reply of the given side to the last move, or -1 if there is none
+	 */
+	int reply_to(unsigned who, int last) const {
+		if (!(flags & mode::lgrf) || last == -1) return -1;
+		return reply[who - 1][last];
+	}
+
+	/**
+	 * learn from a finished playout
+	 * the sequence starts with the last move before the playout, followed by the played moves,
+	 * and the first played move is made by the given side
+	 */
+	void learn(const std::vector<int>& seq, unsigned first, unsigned winner) {
+		for (size_t i = 1; i < seq.size(); i++) {
+			unsigned who = (i % 2) ? first : (3u - first);
+			bool good = (who == winner);
+			if (flags & mode::mast) {
+				stat[who - 1][seq[i]].visit += 1;
+				stat[who - 1][seq[i]].win += good ? 1 : 0;
+			}
+			if ((flags & mode::lgrf) && seq[i - 1] != -1) {
+				int& last = reply[who - 1][seq[i - 1]];
+				if (good) last = seq[i];
+				else if (last == seq[i]) last = -1;
+			}
+		}
+	}
+
+	/**
+	 * play a move sampled in proportion to the pattern weights of the empty points, where an illegal move
+	 * is dropped and sampled again, return the move, or -1 if there is no legal move
+	 */
+	int sample(board& state, std::default_random_engine& engine) const {
+		unsigned who = state.info().who_take_turns;
+		std::array<float, board::size_x * board::size_y> weight;
+		float total = 0;
+		size_t left = 0;
+		for (size_t i = 0; i < weight.size(); i++) {
+			weight[i] = state(i) == board::empty ? weights->weight(state, i, who) : 0;
+			total += weight[i];
+			left += weight[i] > 0;
+		}
+		std::uniform_real_distribution<float> uniform(0, 1);
+		while (left) {
+			float r = uniform(engine) * total;
+			int move = -1;
+			for (size_t i = 0; i < weight.size(); i++) {
+				if (weight[i] <= 0) continue;
+				move = i;
+				if ((r -= weight[i]) < 0) break;
+			}
+			if (state.place(move) == board::legal) return move;
+			total -= weight[move];
+			weight[move] = 0;
+			left--;
+		}
+		return -1;
+	}
+
+	bool enabled(unsigned m) const { return flags & m; }
+
+	/**
+	 * get the weight of the static evaluation in the value of a leaf
+	 */
+	float blend() const { return eval; }
+
+	/**
+	 * get the static evaluation of a position as the probability that black wins
+	 */
+	float evaluate(const board& state) const { return static_eval.black_wins(state); }
+
+	/**
+	 * run the given number of playouts from every leaf, at once on the pool if it is given
+	 */
+	void spread(size_t playouts, pool* workers = nullptr) {
+		leaf = std::max<size_t>(1, playouts);
+		this->workers = workers;
+	}
+	size_t playouts() const { return leaf; }
+	pool* spreader() const { return workers; }
+
+private:
+	struct record { float win, visit; };
+	unsigned flags;
+	float tau;
+	const pattern_weights* weights;
+	float eval;
+	mobility static_eval;
+	size_t leaf;
+	pool* workers;
+	std::array<std::array<record, board::size_x * board::size_y>, 2> stat;
+	std::array<std::array<int, board::size_x * board::size_y>, 2> reply;
+};
+
 class node : board {
 	public:
-		node(const board& state, node* parent = nullptr) : board(state),
-			win(0), visit(0), child(), parent(parent) {}
+		/**
+		 * the tree shape parameters of a search
+		 * a node with n visits may have at most 1 + widen * n^alpha children (all of them if widen <= 0),
+		 * and the selection adds bias * prior / (visit + 1) to the UCB score of each child,
+		 * whose exploration term is weighted by explore (see the selection policies below)
+		 */
+		struct shape {
+			float widen, alpha, bias, explore;
+			shape(float widen = 1, float alpha = 0.5, float bias = 1, float explore = std::sqrt(2))
+				: widen(widen), alpha(alpha), bias(bias), explore(explore) {}
+		};
+
+		/**
+		 * the adaptive budget parameters of a search, checked every interval cycles
+		 * the search stops early (if stop is set) once the best child leads the second by more visits
+		 * than remain, and is extended once by extend * N cycles if the second has at least close times the visits
+		 * of the best, or if the best child changed in the last late fraction of the budget
+		 */
+		struct budget {
+			size_t interval;
+			float extend, close, late;
+			bool stop;
+			budget(size_t interval = 16, float extend = 0.25, float close = 0.8, float late = 0.1, bool stop = true)
+				: interval(interval), extend(extend), close(close), late(late), stop(stop) {}
+		};
+
+		/**
+		 * the proof of a node for its side to move, as marked by the search
+		 * a node without legal move is a proven loss, a node with a proven-loss child is a proven win,
+		 * and a fully-expanded node whose children are all proven wins is a proven loss
+		 */
+		enum proof { unproven = 0, proven_win = 1, proven_loss = -1 };
+
+		/**
+		 * the statistics of a position in the tree
+		 * the wins are counted for the side who made the move leading to it, and are fractional
+		 * if the leaves are valued by a probability that black wins;
+		 * the seeds are the statistics that are not added to the cache by record(): the priors taken
+		 * from the cache or the book, and the statistics that have been recorded already
+		 */
+		struct stats {
+			double win = 0;
+			double seed_win = 0;
+			uint32_t visit = 0, seed_visit = 0;
+			int8_t proven = unproven;
+
+			/**
+			 * add visits valued by the probability that black wins, where who is the side to move
+			 */
+			void add(float black, unsigned who, uint32_t count = 1) {
+				visit += count;
+				win += count * ((who == board::white) ? black : 1 - black);
+			}
+		};
+
+		/**
+		 * a child of a node, i.e., a move with its statistics, whose node is created only when
+		 * the child is selected for the first time; until then, the statistics are kept in the edge,
+		 * and afterwards they are kept in the node
+		 */
+		class edge {
+		public:
+			edge(int move, float prior) : mv(move), pr(prior) {}
+
+			int move() const { return mv; }
+			float prior() const { return pr; }
+			size_t visits() const { return get().visit; }
+			double wins() const { return get().win; }
+			proof proven_state() const { return static_cast<proof>(get().proven); }
+			const node* child() const { return next.get(); }
+
+		protected:
+			friend class node;
+
+			const stats& get() const { return next ? next->stat : stat; }
+			stats& get() { return next ? next->stat : stat; }
+
+			/**
+			 * get the node of this child, and create it from the position of its parent if it is not there
+			 */
+			node* materialize(const board& parent) {
+				if (next) return next.get();
+				board after = parent;
+				after.place(mv);
+				next.reset(new node(after));
+				next->stat = stat;
+				return next.get();
+			}
+
+		private:
+			int16_t mv;
+			float pr;
+			stats stat;
+			std::unique_ptr<node> next;
+		};
+
+		/**
+		 * the selection policies, which score a child by its statistics, the visits of its parent, and
+		 * the sum of the priors of all legal moves of the parent; a proven child is scored by select() itself
+		 *
+		 * every policy is a template argument of run_mcts(), so that each one has its own select() loop
+		 */
+		struct ucb1 { // UCB1 with the progressive bias of the prior
+			static float score(const edge& ch, size_t parent, float, const shape& opt, std::default_random_engine&) {
+				float exploit = float(ch.wins())/ch.visits();
+				float explore = sqrt(log(parent)/ch.visits());
+				return exploit + opt.explore*explore + opt.bias*ch.prior()/(ch.visits()+1);
+			}
+		};
+		struct ucb1_tuned { // UCB1-Tuned (Auer et al., 2002), where the variance of a win rate p is at most p(1 - p)
+			static float score(const edge& ch, size_t parent, float, const shape& opt, std::default_random_engine&) {
+				float exploit = float(ch.wins())/ch.visits();
+				float logn = log(parent)/ch.visits();
+				float variance = exploit*(1-exploit) + sqrt(2*logn);
+				return exploit + sqrt(logn*std::min(0.25f, variance)) + opt.bias*ch.prior()/(ch.visits()+1);
+			}
+		};
+		struct puct { // PUCT with the priors normalized over the legal moves, and explore as c_puct
+			static float score(const edge& ch, size_t parent, float total, const shape& opt, std::default_random_engine&) {
+				float exploit = float(ch.wins())/ch.visits();
+				float p = (ch.prior() + puct_floor) / total;
+				return exploit + opt.explore*p*sqrt(float(parent))/(1+ch.visits());
+			}
+		};
+		struct thompson { // Thompson sampling from the Beta posterior of the win rate under a uniform prior
+			static float score(const edge& ch, size_t, float, const shape&, std::default_random_engine& engine) {
+				float win = ch.wins(), loss = ch.visits() - ch.wins();
+				float x = std::gamma_distribution<float>(win + 1)(engine);
+				float y = std::gamma_distribution<float>(loss + 1)(engine);
+				return x / (x + y);
+			}
+		};
 
 		/**
-		 * run MCTS for N cycles and retrieve the best action
+		 * the state of a search of N cycles, which may run in slices, see run_slice()
 		 */
-		action run_mcts(size_t flag, int count, size_t N, std::default_random_engine& engine) {
+		struct progress {
+			size_t N, limit, done, changed;
+			int last_best;
+			bool finished;
+			progress(size_t N = 0) : N(N), limit(N), done(0), changed(0), last_best(-1), finished(N == 0) {}
+		};
+
+		node(const board& state) : board(state) {}
+
+		/**
+		 * run MCTS for about N cycles with the given selection policy and retrieve the best action
+		 */
+		template<typename selection = ucb1>
+		action run_mcts(size_t flag, int count, size_t N, std::default_random_engine& engine, playout_policy& policy,
+				const shape& opt = {}, const budget& adapt = {}, const position_cache* cache = nullptr,
+				const position_book* book = nullptr, const std::function<void(const node&)>& monitor = nullptr) {
 			if (flag == 1){
 				N = (48-count)*N/31;
 			}
-			for(size_t i = 0; i < N; i++){
-				std::vector<node*> path = select();
-				node* leaf = path.back()->expand(engine);
-				if (leaf != path.back())
-					path.push_back(leaf);
-				update(path, leaf->simulate(engine));
-			}
+			progress search(N);
+			run_slice<selection>(search, -1, engine, policy, opt, adapt, cache, book, monitor);
 			return take_action();
 		}
 
+		/**
+		 * run at most the given number of cycles of a search, and return whether the search is finished,
+		 * so that a search can be paused between slices and resumed later on any thread
+		 */
+		template<typename selection = ucb1>
+		bool run_slice(progress& search, size_t cycles, std::default_random_engine& engine, playout_policy& policy,
+				const shape& opt = {}, const budget& adapt = {}, const position_cache* cache = nullptr,
+				const position_book* book = nullptr, const std::function<void(const node&)>& monitor = nullptr) {
+			const size_t N = search.N;
+			size_t& limit = search.limit;
+			for(size_t k = 0; k < cycles && search.done < limit && !search.finished; k++){
+				size_t i = search.done++;
+				std::vector<node*> path = select<selection>(engine, opt);
+				board leaf = *path.back();
+				edge* fresh = path.back()->expand(engine, opt, leaf, cache, book);
+				update(path, fresh, evaluate(leaf, engine, policy), policy.playouts());
+
+				if ((i + 1) % adapt.interval != 0 && i + 1 != limit) continue;
+				if (monitor) monitor(*this);
+				std::pair<const edge*, const edge*> top = best_children();
+				if (!top.first) continue;
+				if (top.first->move() != search.last_best) {
+					search.last_best = top.first->move();
+					search.changed = i + 1;
+				}
+				size_t lead = top.first->visits() - (top.second ? top.second->visits() : 0);
+				if (adapt.stop && lead > (limit - (i + 1)) * policy.playouts()) search.finished = true; // the best child can no longer be overtaken
+				if (i + 1 == N && limit == N && adapt.extend > 0) {
+					bool close = top.second && top.second->visits() >= adapt.close * top.first->visits();
+					bool late = search.changed + adapt.late * N >= N;
+					if (close || late) limit += size_t(adapt.extend * N);
+				}
+			}
+			if (search.done >= limit) search.finished = true;
+			return search.finished;
+		}
+
 	protected:
 
 		/**
-		 * select from the current node to a leaf node by UCB and return all of them
-		 * a leaf node can be either a node that is not fully expanded or a terminal node
+		 * select from the current node to a leaf node by the selection policy and return all of them
+		 * a leaf node can be either a node that may still be widened or a terminal node
+		 * the node of a selected child is created when it is selected for the first time
 		 */
-		std::vector<node*> select() {
-			int count=0;
+		template<typename selection>
+		std::vector<node*> select(std::default_random_engine& engine, const shape& opt) {
 			std::vector<node*> path = { this };
 			node* cur_node = this;
-			node* max_node = nullptr;
-			float max_score = 0;
-			while(cur_node->is_selectable()){
-				max_score = -1;
+			while(cur_node->is_selectable(engine, opt)){
+				edge* max_edge = nullptr;
+				float max_score = -1e10f;
 				for(size_t i=0; i<cur_node->child.size();i++){
-					if(cur_node->child[i].ucb_score() > max_score){
-						if (cur_node->child[i].ucb_score()<0) count++;
-						max_score = cur_node->child[i].ucb_score();
-						max_node = &cur_node->child[i];
+					const edge& ch = cur_node->child[i];
+					float score = ch.get().proven ? (ch.get().proven == proven_loss ? 1e9f : -1e9f)
+						: selection::score(ch, cur_node->stat.visit, cur_node->prior_total, opt, engine);
+					if(score > max_score){
+						max_score = score;
+						max_edge = &cur_node->child[i];
 					}
 				}
-				cur_node = max_node;
+				cur_node = max_edge->materialize(*cur_node);
 				path.push_back(cur_node);
 			}
 			return path;
 		}
+
 		/**
-		 * expand the current node and return the newly expanded child node
-		 * if the current node has no unexpanded move, it returns itself
+		 * expand the current node by a new child, play its move on the leaf position, and return the child
+		 * children are added in prior order, and only as many as the visit count allows
+		 * if the current node cannot be widened now, it returns null and the leaf is not changed
+		 * a new child recorded in the cache starts with the cached statistics as its prior,
+		 * or else with the statistics of the book if it is there
 		 */
+		edge* expand(std::default_random_engine& engine, const shape& opt, board& leaf,
+				const position_cache* cache = nullptr, const position_book* book = nullptr) {
+			const std::vector<int>& moves = legal_moves(engine);
+			if (child.size() >= width(opt))
+				return nullptr;
+			leaf.place(moves[child.size()]);
+			child.emplace_back(moves[child.size()], priors[child.size()]);
+			if (cache) warm_up(child.back().stat, leaf, *cache);
+			if (book && !child.back().stat.seed_visit) warm_up(child.back().stat, leaf, *book);
+			return &child.back();
+		}
 
-		node* expand(std::default_random_engine& engine) {
-			board cur_board = *this;
-			std::vector<int> moves = all_moves(engine);
-			for (int move : moves) {
-				size_t i = 0;
-				for(i=0; i<child.size();i++){
-					if (child[i].info().last_move.i == move){
-						break;
-					}
+		/**
+		 * evaluate a leaf position and return the probability that black wins, which is the result
+		 * of a playout mixed with the static evaluation by the weight of the policy
+		 */
+		static float evaluate(const board& leaf, std::default_random_engine& engine, playout_policy& policy) {
+			float eval = policy.blend(), black = 0;
+			if (eval < 1) black += (1 - eval) * simulate(leaf, engine, policy);
+			if (eval > 0) black += eval * policy.evaluate(leaf);
+			return black;
+		}
+
+		/**
+		 * simulate a leaf position by the playouts of the policy and return the fraction that black wins
+		 * on a pool, every playout has its own seed drawn from the engine, and the policy learns
+		 * from them in order after all of them are finished; the playouts run as a group of the pool,
+		 * so the search never waits for an unrelated task while it helps with them
+		 */
+		static float simulate(const board& leaf, std::default_random_engine& engine, playout_policy& policy) {
+			size_t n = policy.playouts();
+			unsigned who = leaf.info().who_take_turns;
+			if (n == 1 || !policy.spreader()) {
+				size_t wins = 0;
+				for (size_t i = 0; i < n; i++) {
+					std::vector<int> seq;
+					unsigned winner = playout(leaf, engine, policy, seq);
+					policy.learn(seq, who, winner);
+					wins += (winner == board::black);
 				}
-				if (i == child.size() && cur_board.place(move) == board::legal){
-					// this->child.push_back(cur_board);
-					this->child.push_back(node(cur_board, this));
-					return &child.back();
-				}		
+				return float(wins) / n;
+			}
+			std::vector<unsigned> seeds(n), winners(n);
+			std::vector<std::vector<int>> seqs(n);
+			for (unsigned& seed : seeds) seed = engine();
+			policy.spreader()->group(n, [&](size_t i) {
+				std::default_random_engine local(seeds[i]);
+				winners[i] = playout(leaf, local, policy, seqs[i]);
+			});
+			size_t wins = 0;
+			for (size_t i = 0; i < n; i++) {
+				policy.learn(seqs[i], who, winners[i]);
+				wins += (winners[i] == board::black);
 			}
-			return this;
+			return float(wins) / n;
 		}
 
 		/**
-		 * simulate the current node and return the winner
+		 * play out a leaf position, keep the last move and the played moves in seq, and return the winner
+		 * the playout tries the reply suggested by the policy first, then the moves in policy order,
+		 * or with pattern weights, a move sampled by the weights
 		 */
-		unsigned simulate(std::default_random_engine& engine) {
-			board cur_board = *this;
-			bool is_game_end = false;
-			std::vector<int> moves = all_moves(engine);
+		static unsigned playout(const board& leaf, std::default_random_engine& engine, const playout_policy& policy,
+				std::vector<int>& seq) {
+			seq.assign(1, leaf.info().last_move.i);
+			if (!policy.enabled(playout_policy::pattern)) {
+				std::vector<int> moves[2] = { policy.order(board::black, engine), {} };
+				moves[1] = policy.enabled(playout_policy::mast) ? policy.order(board::white, engine) : moves[0];
+				static unsigned (* const variant[isa::levels])(const board&, const playout_policy&, const std::vector<int>*,
+						std::vector<int>&) = { playout_baseline, playout_sse42, playout_avx2 };
+				return variant[isa::selected()](leaf, policy, moves, seq);
+			}
 
-			while(!is_game_end){
-				bool is_find_legal = false;
-				for (int move : moves)
-					if (cur_board.place(move) == board::legal){
-						is_find_legal = true;
-						break;
-					}
-				if (!is_find_legal)
-					is_game_end = true;
+			board cur_board = leaf;
+			while(true){
+				unsigned who = cur_board.info().who_take_turns;
+				int reply = policy.reply_to(who, seq.back());
+				if (reply != -1 && cur_board.place(reply) == board::legal){
+					seq.push_back(reply);
+					continue;
+				}
+				int move = policy.sample(cur_board, engine);
+				if (move == -1) break;
+				seq.push_back(move);
 			}
 
-			return  (cur_board.info().who_take_turns == board::white)? board::black:board::white;
+			return (cur_board.info().who_take_turns == board::white)? board::black:board::white;
 		}
 
 		/**
-		 * update statistics for all nodes saved in the path
+		 * play out on a bitboard the same moves as the board would, without the pattern weights:
+		 * the legal moves of a turn are found at once, and the first of the reply and the move order is played
 		 */
-		void update(std::vector<node*>& path, unsigned winner) {
-			for (node* path_node : path) {
-				path_node->visit++;
-				if (winner == info().who_take_turns)
-					path_node->win++;
+		ISA_INLINE static unsigned playout_moves(const board& leaf, const playout_policy& policy,
+				const std::vector<int>* moves, std::vector<int>& seq) {
+			bitboard cur(leaf);
+			for (bitboard::mask legal; (legal = cur.legal()) != 0; ) {
+				unsigned who = cur.who_take_turns();
+				int move = policy.reply_to(who, seq.back());
+				if (move == -1 || !(legal & bitboard::bit(move)))
+					for (int m : moves[who - 1])
+						if (legal & bitboard::bit(m)) { move = m; break; }
+				cur.play(move);
+				seq.push_back(move);
 			}
+			return 3u - cur.who_take_turns();
 		}
+		static unsigned playout_baseline(const board& leaf, const playout_policy& policy,
+				const std::vector<int>* moves, std::vector<int>& seq) { return playout_moves(leaf, policy, moves, seq); }
+		ISA_SSE42 static unsigned playout_sse42(const board& leaf, const playout_policy& policy,
+				const std::vector<int>* moves, std::vector<int>& seq) { return playout_moves(leaf, policy, moves, seq); }
+		ISA_AVX2 static unsigned playout_avx2(const board& leaf, const playout_policy& policy,
+				const std::vector<int>* moves, std::vector<int>& seq) { return playout_moves(leaf, policy, moves, seq); }
 
 		/**
-		 * pick the best action by visit counts
+		 * update statistics for all nodes saved in the path, and for the new child if there is one,
+		 * with the given number of playouts valued together
 		 */
-		action take_action() const {
-			int max_visit = -1;
-			const node* best_node = NULL;
-			for(size_t i=0; i<child.size();i++){
-				if(int(child[i].visit) > max_visit){
-					max_visit = int(child[i].visit);
-					best_node = &child[i];
+		void update(std::vector<node*>& path, edge* fresh, float black, uint32_t count = 1) {
+			for (node* path_node : path)
+				path_node->stat.add(black, path_node->info().who_take_turns, count);
+			if (fresh)
+				fresh->stat.add(black, 3u - path.back()->info().who_take_turns, count);
+			for (size_t i = path.size(); i > 0 && path[i - 1]->prove(); i--);
+		}
+
+		/**
+		 * try to prove this node from its children, and return whether it is proven
+		 */
+		bool prove() {
+			if (stat.proven) return true;
+			bool all_win = generated && child.size() == moves.size();
+			for (const edge& ch : child) {
+				if (ch.get().proven == proven_loss) {
+					stat.proven = proven_win;
+					return true;
 				}
+				if (ch.get().proven != proven_win) all_win = false;
 			}
-			if (best_node != NULL)
-				return action::place(best_node->info().last_move, info().who_take_turns);
+			if (all_win) stat.proven = proven_loss;
+			return stat.proven;
+		}
+
+	public:
+
+		int move() const { return info().last_move.i; }
+		unsigned turn() const { return info().who_take_turns; }
+		size_t visits() const { return stat.visit; }
+		double wins() const { return stat.win; }
+		proof proven_state() const { return static_cast<proof>(stat.proven); }
+		const std::vector<edge>& children() const { return child; }
+
+		/**
+		 * add the statistics found by the search for this node and its children to the cache,
+		 * excluding the priors taken from the cache, and skipping nodes with too few visits
+		 * the recorded statistics become seeds, so a subtree reused by the next search adds only
+		 * the visits made since then
+		 */
+		void record(position_cache& cache, size_t min_visits = 8) {
+			auto add = [&](const board& state, stats& s) {
+				if (s.visit - s.seed_visit < min_visits) return;
+				cache.add(state, s.visit - s.seed_visit, s.win - s.seed_win);
+				s.seed_visit = s.visit;
+				s.seed_win = s.win;
+			};
+			add(*this, stat);
+			for (edge& ch : child) {
+				if (ch.get().visit - ch.get().seed_visit < min_visits) continue;
+				board after = *this;
+				after.place(ch.move());
+				add(after, ch.get());
+			}
+		}
+
+		/**
+		 * get the principal variation, i.e., the moves by following the most visited children
+		 */
+		std::vector<int> principal_variation() const {
+			std::vector<int> pv;
+			for (const node* n = this; n; ) {
+				const edge* best = n->best_children().first;
+				if (!best) break;
+				pv.push_back(best->move());
+				n = best->child();
+			}
+			return pv;
+		}
+
+		/**
+		 * check whether this node is the given position with the same side to move
+		 */
+		bool matches(const board& state) const {
+			return static_cast<const board&>(*this) == state && info().who_take_turns == state.info().who_take_turns;
+		}
+
+		/**
+		 * move the subtree of the given position out of this tree, looking at most two plies deep
+		 * return null if the position is not in the tree
+		 */
+		std::unique_ptr<node> subtree(const board& state) {
+			node* found = matches(state) ? this : nullptr;
+			for (size_t i = 0; i < child.size() && !found; i++) {
+				board after = *this;
+				after.place(child[i].move());
+				if (after == state && after.info().who_take_turns == state.info().who_take_turns)
+					found = child[i].materialize(*this);
+				const node* ch = child[i].child();
+				for (size_t j = 0; ch && j < ch->child.size() && !found; j++) {
+					board next = after;
+					next.place(ch->child[j].move());
+					if (next == state && next.info().who_take_turns == state.info().who_take_turns)
+						found = child[i].next->child[j].materialize(after);
+				}
+			}
+			if (!found) return nullptr;
+			return std::unique_ptr<node>(new node(std::move(*found)));
+		}
+
+		/**
+		 * write the tree in a compact binary format: a header with the root position,
+		 * then every node in preorder as (move, visits, wins, proof, number of children)
+		 */
+		void save(std::ostream& out) const {
+			out.write(tree_magic, sizeof(tree_magic));
+			put<uint32_t>(out, tree_version);
+			for (int i = 0; i < board::size_x * board::size_y; i++)
+				put<uint8_t>(out, (*this)(i));
+			put<uint8_t>(out, info().who_take_turns);
+			put<int16_t>(out, info().last_move.i);
+			save_node(out, info().last_move.i, stat, this);
+		}
+
+		/**
+		 * read a tree written by save(), or return null if the data is broken
+		 */
+		static std::unique_ptr<node> load(std::istream& in) {
+			char magic[sizeof(tree_magic)];
+			uint32_t version;
+			if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), tree_magic)) return nullptr;
+			if (!get(in, version) || version != tree_version) return nullptr;
+			board::grid stone;
+			for (int i = 0; i < board::size_x * board::size_y; i++) {
+				uint8_t cell;
+				if (!get(in, cell)) return nullptr;
+				stone[i / board::size_y][i % board::size_y] = cell;
+			}
+			uint8_t who;
+			int16_t last;
+			if (!get(in, who) || !get(in, last)) return nullptr;
+			std::unique_ptr<node> root(new node(board(stone, { static_cast<board::piece_type>(who), last })));
+			int16_t move;
+			uint8_t children;
+			if (!get(in, move) || !load_stats(in, root->stat, children) || !root->load_node(in, children)) return nullptr;
+			return root;
+		}
+
+		/**
+		 * get the win rate of the best child for the side to move, or 0.5 if there is no child
+		 */
+		float win_rate() const {
+			const edge* best = best_children().first;
+			return (best && best->visits()) ? float(best->wins()) / best->visits() : 0.5f;
+		}
+
+	protected:
+
+		/**
+		 * pick the best action by visit counts
+		 */
+		action take_action() const {
+			const edge* best = best_children().first;
+			for (const edge& ch : child)
+				if (ch.get().proven == proven_loss) best = &ch;
+			if (best != NULL)
+				return action::place(best->move(), info().who_take_turns);
 			else
 				return action();
 		}
 
+		/**
+		 * get the children with the most and the second most visits, which may be null
+		 */
+		std::pair<const edge*, const edge*> best_children() const {
+			const edge* first = nullptr;
+			const edge* second = nullptr;
+			for (const edge& ch : child) {
+				if (!first || ch.visits() > first->visits()) {
+					second = first;
+					first = &ch;
+				} else if (!second || ch.visits() > second->visits()) {
+					second = &ch;
+				}
+			}
+			return { first, second };
+		}
+
 	private:
 
 		/**
-		 * check whether this node is a fully-expanded non-terminal node
+		 * check whether this node is a fully-widened non-terminal node
 		 */
-		bool is_selectable() const {
-			size_t legal_moves = 0;
-			for (int move=0; move<81; move++){
-				board cur_board = board(*this);
-				if (cur_board.place(move) == board::legal)
-					legal_moves++;
-			}			
-			if (legal_moves == 0) // leaf_node
-				return false;
-			else if (legal_moves == child.size()) // fully-expanded
-				return true;
-			else // non-fully-expanded
-				return false; 
+		bool is_selectable(std::default_random_engine& engine, const shape& opt) {
+			return legal_moves(engine).size() && child.size() >= width(opt);
+		}
 
+		/**
+		 * get the number of children allowed by the current visit count
+		 */
+		size_t width(const shape& opt) const {
+			if (opt.widen <= 0) return moves.size();
+			size_t allowed = 1 + size_t(opt.widen * std::pow(float(stat.visit), opt.alpha));
+			return std::min(allowed, moves.size());
 		}
 
 		/**
-		 * get the ucb score of this node
+		 * get all legal moves sorted by their priors, which are generated at the first call
 		 */
-		float ucb_score(float c = std::sqrt(2)) const {
-			float exploit = float(win)/visit;
-			float explore = sqrt(log(parent->visit)/visit);
-			return exploit + c*explore;
+		const std::vector<int>& legal_moves(std::default_random_engine& engine) {
+			if (generated) return moves;
+			generated = true;
+			std::vector<std::pair<float, int>> order;
+			for (int move : all_moves(engine)) {
+				board after = *this;
+				if (after.place(move) == board::legal)
+					order.emplace_back(prior_of(move), move);
+			}
+			std::stable_sort(order.begin(), order.end(),
+				[](const std::pair<float, int>& a, const std::pair<float, int>& b) { return a.first > b.first; });
+			for (auto& entry : order) {
+				priors.push_back(entry.first);
+				moves.push_back(entry.second);
+			}
+			// children loaded from a file come first, since expand() takes the moves after them
+			for (size_t i = 0; i < child.size(); i++) {
+				size_t k = std::find(moves.begin() + i, moves.end(), child[i].move()) - moves.begin();
+				if (k == moves.size()) continue;
+				std::rotate(moves.begin() + i, moves.begin() + k, moves.begin() + k + 1);
+				std::rotate(priors.begin() + i, priors.begin() + k, priors.begin() + k + 1);
+				child[i].pr = priors[i];
+			}
+			for (float prior : priors) prior_total += prior + puct_floor;
+			if (moves.empty()) stat.proven = proven_loss;
+			child.reserve(moves.size());
+			return moves;
+		}
+
+		/**
+		 * take at most cache.warm visits with the cached win rate as the prior statistics of a position
+		 */
+		static void warm_up(stats& s, const board& state, const position_cache& cache) {
+			uint64_t visits;
+			double wins;
+			if (!cache.find(state, visits, wins) || visits == 0) return;
+			s.seed_visit = std::min<uint64_t>(visits, cache.warm);
+			s.seed_win = wins / visits * s.seed_visit;
+			s.visit += s.seed_visit;
+			s.win += s.seed_win;
+		}
+
+		/**
+		 * take at most book.warm visits with the win rate of the archived games as the prior statistics
+		 * of a position, where the win counts for the side who moved into this position
+		 */
+		static void warm_up(stats& s, const board& state, const position_book& book) {
+			uint32_t games, black_wins;
+			if (!book.find(state, games, black_wins) || games == 0) return;
+			double wins = (state.info().who_take_turns == board::white) ? black_wins : games - black_wins;
+			s.seed_visit = std::min<uint64_t>(games, book.warm);
+			s.seed_win = wins / games * s.seed_visit;
+			s.visit += s.seed_visit;
+			s.win += s.seed_win;
+		}
+
+		/**
+		 * write a node, or a child without its node, and the children of the node
+		 */
+		static void save_node(std::ostream& out, int move, const stats& s, const node* n) {
+			put<int16_t>(out, move);
+			put<uint32_t>(out, s.visit);
+			put<float>(out, s.win);
+			put<int8_t>(out, s.proven);
+			put<uint8_t>(out, n ? n->child.size() : 0);
+			if (n) for (const edge& ch : n->child) save_node(out, ch.move(), ch.get(), ch.child());
+		}
+
+		static bool load_stats(std::istream& in, stats& s, uint8_t& children) {
+			uint32_t visits;
+			float wins;
+			int8_t proof;
+			if (!get(in, visits) || !get(in, wins) || !get(in, proof) || !get(in, children)) return false;
+			s.visit = visits;
+			s.win = wins;
+			s.proven = proof;
+			return true;
+		}
+
+		/**
+		 * read the children of this node, whose moves are replayed on this position
+		 * a child without children of its own is kept as an edge without its node
+		 */
+		bool load_node(std::istream& in, size_t children) {
+			child.reserve(children);
+			for (size_t i = 0; i < children; i++) {
+				int16_t move;
+				uint8_t grandchildren;
+				board after = *this;
+				if (!get(in, move) || after.place(move) != board::legal) return false;
+				child.emplace_back(move, 0);
+				if (!load_stats(in, child.back().stat, grandchildren)) return false;
+				if (grandchildren && !child.back().materialize(*this)->load_node(in, grandchildren)) return false;
+			}
+			return true;
+		}
+
+		template<typename type> static void put(std::ostream& out, type value) {
+			out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+		}
+		template<typename type> static bool get(std::istream& in, type& value) {
+			return bool(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+		}
+
+		/**
+		 * get the heuristic prior of a legal move in [0, 1]
+		 * a point that the opponent can also play is contested and worth taking first,
+		 * while a point that only we can play is kept for later;
+		 * moves next to opponent stones are preferred since they take the opponent's liberties
+		 */
+		float prior_of(int move) const {
+			board::piece_type who = info().who_take_turns;
+			board::piece_type opp = static_cast<board::piece_type>(3u - who);
+			board opp_turn = *this;
+			opp_turn.info({opp, info().last_move});
+			bool contested = (opp_turn.place(move) == board::legal);
+
+			board::point p(move);
+			int near_opp = 0;
+			if (p.x > 0                  && (*this)[p.x - 1][p.y] == opp) near_opp++;
+			if (p.x < board::size_x - 1 && (*this)[p.x + 1][p.y] == opp) near_opp++;
+			if (p.y > 0                  && (*this)[p.x][p.y - 1] == opp) near_opp++;
+			if (p.y < board::size_y - 1 && (*this)[p.x][p.y + 1] == opp) near_opp++;
+			return (contested ? 0.6f : 0.0f) + 0.1f * near_opp;
 		}
 
 		/**
@@ -182,11 +862,22 @@ class node : board {
 		}
 
 	private:
-		size_t win, visit;
-		std::vector<node> child;
-		node* parent;
+		stats stat;
+		std::vector<edge> child;
+		bool generated = false;
+		std::vector<int> moves;
+		std::vector<float> priors;
+		float prior_total = 0;
+
+		static constexpr float puct_floor = 0.05f; // added to every prior, so that PUCT tries every move
+		static constexpr char tree_magic[8] = { 'N', 'O', 'G', 'O', 'T', 'R', 'E', 'E' };
+		static constexpr uint32_t tree_version = 1;
 };
 
+constexpr float node::puct_floor;
+constexpr char node::tree_magic[8];
+constexpr uint32_t node::tree_version;
+
 class agent {
 public:
 	agent(const std::string& args = "") {
@@ -202,6 +893,12 @@ public:
 	virtual void close_episode(const std::string& flag = "") {}
 	virtual action take_action(const board& b) { return action(); }
 	virtual bool check_for_win(const board& b) { return false; }
+	virtual bool save_tree(const std::string& path) const { return false; }
+	virtual bool load_tree(const std::string& path) { return false; }
+	virtual void ponder(const board& b, size_t N) {}
+	virtual void start_ponder(const board& b, size_t N) {}
+	virtual bool resume_ponder(size_t cycles) { return true; }
+	virtual std::string analysis(const std::string& kind) const { return ""; }
 
 public:
 	virtual std::string property(const std::string& key) const { return meta.at(key); }
@@ -231,6 +928,11 @@ public:
 	}
 	virtual ~random_agent() {}
 
+	/**
+	 * restart the random number generator, e.g., so that a game does not depend on the games before it
+	 */
+	void reseed(unsigned seed) { engine.seed(seed); }
+
 protected:
 	std::default_random_engine engine;
 };
@@ -253,6 +955,101 @@ public:
 			throw std::invalid_argument("invalid role: " + role());
 		for (size_t i = 0; i < space.size(); i++)
 			space[i] = action::place(i, who);
+		if (meta.find("playout") != meta.end()) {
+			std::string playout = property("playout");
+			if (playout.find("mast") != std::string::npos) playout_flags |= playout_policy::mast;
+			if (playout.find("lgrf") != std::string::npos) playout_flags |= playout_policy::lgrf;
+		}
+		if (meta.find("tau") != meta.end())
+			playout_tau = meta["tau"];
+		if (meta.find("eval") != meta.end())
+			eval = meta["eval"];
+		if (meta.find("leaf") != meta.end())
+			leaf = meta["leaf"];
+		if (meta.find("concurrent") != meta.end())
+			concurrent = int(meta["concurrent"]);
+		if (meta.find("patterns") != meta.end())
+			patterns.reset(new pattern_weights(property("patterns")));
+		if (meta.find("widen") != meta.end())
+			tree_shape.widen = meta["widen"];
+		if (meta.find("alpha") != meta.end())
+			tree_shape.alpha = meta["alpha"];
+		if (meta.find("bias") != meta.end())
+			tree_shape.bias = meta["bias"];
+		if (meta.find("explore") != meta.end())
+			tree_shape.explore = meta["explore"];
+		if (meta.find("select") != meta.end())
+			selection = property("select");
+		if (selection != "ucb1" && selection != "tuned" && selection != "puct" && selection != "thompson")
+			throw std::invalid_argument("invalid selection: " + selection);
+		if (meta.find("extend") != meta.end())
+			search_budget.extend = meta["extend"];
+		if (meta.find("close") != meta.end())
+			search_budget.close = meta["close"];
+		if (meta.find("stop") != meta.end())
+			search_budget.stop = int(meta["stop"]);
+		if (meta.find("parallel") != meta.end())
+			trees = meta["parallel"];
+		if (meta.find("tree") != meta.end())
+			load_tree(property("tree"));
+		if (meta.find("live") != meta.end())
+			live = meta["live"];
+		if (meta.find("cache") != meta.end())
+			cache.reset(new position_cache(property("cache")));
+		if (meta.find("book") != meta.end())
+			book.reset(new position_book(property("book")));
+		if (cache && meta.find("warm") != meta.end())
+			cache->warm = meta["warm"];
+		if (book && meta.find("warm") != meta.end())
+			book->warm = meta["warm"];
+		if (meta.find("deterministic") != meta.end())
+			deterministic = int(meta["deterministic"]);
+		if (meta.find("resign") != meta.end())
+			resign = meta["resign"];
+		if (meta.find("adjudicate") != meta.end())
+			adjudicate = meta["adjudicate"];
+		if (meta.find("verify") != meta.end())
+			verify = meta["verify"];
+	}
+
+	virtual void open_episode(const std::string& flag = "") {
+		claimed = false;
+		if (meta.find("tree") == meta.end()) tree.reset();
+	}
+
+	virtual void close_episode(const std::string& flag = "") {
+		if (claimed) {
+			verified++;
+			if (flag != name()) mistaken++;
+		}
+	}
+
+	/**
+	 * claim the win after playing a move, i.e., let the opponent resign,
+	 * if the search is confident enough or the endgame is proven to be won
+	 * a fraction of the claims are not taken but played out to verify them
+	 */
+	virtual bool check_for_win(const board& state) {
+		if (claimed) return false;
+		bool claim = (resign > 0 && last_value >= 1 - resign);
+		if (!claim && adjudicate && solver::empties(state) <= adjudicate)
+			claim = (solver().solve(state) == solver::lose);
+		if (!claim) return false;
+		if (verify > 0 && std::uniform_real_distribution<float>(0, 1)(engine) < verify) {
+			claimed = true;
+			return false;
+		}
+		claims++;
+		return true;
+	}
+
+	/**
+	 * report the claims taken, and the claims played out with their mistakes
+	 */
+	std::string claim_summary() const {
+		std::stringstream ss;
+		ss << name() << " claims = " << claims << ", verified = " << verified << " (" << mistaken << " mistaken)";
+		return ss.str();
 	}
 
 	virtual action take_action(const board& state) {
@@ -267,20 +1064,276 @@ public:
 		}
 		if (cnt ==1 || cnt == 0) count = 0;
 		count+=1;
-		std::cout<<"count:"<<count<<"\n";
+		std::cerr<<"count:"<<count<<"\n";
 		clock_t a=clock(); 
-		action result = node(state).run_mcts(flag, count, N, engine);
+		action result;
+		if (trees > 1) {
+			result = run_parallel(state, flag, N);
+		} else {
+			result = search(state, flag, N, search_budget);
+		}
 		clock_t b=clock();
 		total_time += double(b-a)/CLOCKS_PER_SEC;
-		std::cout<<double(b-a)/CLOCKS_PER_SEC<<" "<<total_time<<std::endl;
+		std::cerr<<double(b-a)/CLOCKS_PER_SEC<<" "<<total_time<<std::endl;
 		return result;
 	}
 
+	/**
+	 * search the state for N cycles without playing, e.g., for analysis
+	 */
+	virtual void ponder(const board& state, size_t N) {
+		start_ponder(state, N);
+		resume_ponder(-1);
+	}
+
+	/**
+	 * start pondering the state for N cycles, which are run by resume_ponder() in slices
+	 */
+	virtual void start_ponder(const board& state, size_t N) {
+		pending.reset(new pondering(playout_policy(playout_flags, playout_tau, patterns.get(), eval), N));
+		pending->policy.spread(leaf, concurrent ? &pool::shared() : nullptr);
+		pending->adapt = search_budget;
+		pending->adapt.extend = 0;
+		pending->adapt.stop = false;
+		pending->root = tree ? tree->subtree(state) : nullptr;
+		if (!pending->root) pending->root.reset(new node(state));
+	}
+
+	/**
+	 * run at most the given number of cycles of the pondering, and return whether it is finished,
+	 * after which its tree is kept as the tree of the last search
+	 */
+	virtual bool resume_ponder(size_t cycles) {
+		if (!pending) return true;
+		pondering& p = *pending;
+		auto monitor = [&](const node& n) {
+			auto now = std::chrono::steady_clock::now();
+			if (now - p.last < std::chrono::milliseconds(live)) return;
+			std::cerr << "gogui-gfx:\n" << gfx(n, "visits") << "\n\n" << std::flush;
+			p.last = now;
+		};
+		if (!run_slice(*p.root, p.search, cycles, engine, p.policy, tree_shape, p.adapt,
+				deterministic ? nullptr : cache.get(), book.get(),
+				live ? std::function<void(const node&)>(monitor) : nullptr)) return false;
+		keep(std::move(p.root));
+		pending.reset();
+		return true;
+	}
+
+	/**
+	 * get the GoGui analysis of the last search, where kind is one of
+	 *  "visits": gfx labels of the visit counts of the root children
+	 *  "winrates": gfx influence and labels (in percent) of the win rates of the root children
+	 *  "pv": var moves of the principal variation
+	 */
+	virtual std::string analysis(const std::string& kind) const {
+		return tree ? gfx(*tree, kind) : "";
+	}
+
+	static std::string gfx(const node& root, const std::string& kind) {
+		std::stringstream ss;
+		if (kind == "pv") {
+			const char* color = "?BW?";
+			unsigned who = root.turn();
+			for (int move : root.principal_variation()) {
+				ss << color[who] << ' ' << board::point(move) << ' ';
+				who = 3u - who;
+			}
+		} else if (kind == "visits") {
+			ss << "LABEL";
+			for (const node::edge& ch : root.children())
+				ss << ' ' << board::point(ch.move()) << ' ' << ch.visits();
+			ss << "\nTEXT visits = " << root.visits() << ", win rate = " << int(root.win_rate() * 100) << "%";
+		} else if (kind == "winrates") {
+			std::stringstream label;
+			ss << "INFLUENCE";
+			label << "LABEL";
+			for (const node::edge& ch : root.children()) {
+				float rate = ch.visits() ? float(ch.wins()) / ch.visits() : 0.5f;
+				ss << ' ' << board::point(ch.move()) << ' ' << (rate * 2 - 1);
+				label << ' ' << board::point(ch.move()) << ' ' << int(rate * 100);
+			}
+			ss << "\n" << label.str();
+		}
+		return ss.str();
+	}
+
+	/**
+	 * save the tree of the last search, which is kept to continue searching later
+	 * the tree is written to a temporary file and renamed to the path, so players of other threads
+	 * or processes saving to the same path never mix their trees, and the last one is kept
+	 */
+	virtual bool save_tree(const std::string& path) const {
+		if (!tree) return false;
+		static std::atomic<unsigned> serial(0);
+		std::string temp = path + ".tmp." + std::to_string(::getpid()) + "." + std::to_string(serial++);
+		std::ofstream out(temp, std::ios::out | std::ios::binary | std::ios::trunc);
+		tree->save(out);
+		out.close();
+		if (out && std::rename(temp.c_str(), path.c_str()) == 0) return true;
+		std::remove(temp.c_str());
+		return false;
+	}
+
+	/**
+	 * load a tree, which is searched further when its position is reached
+	 */
+	virtual bool load_tree(const std::string& path) {
+		std::ifstream in(path, std::ios::in | std::ios::binary);
+		std::unique_ptr<node> root = node::load(in);
+		if (!root) return false;
+		tree = std::move(root);
+		return true;
+	}
+
+	/**
+	 * add the claim counts of another player, e.g., a player of another thread
+	 */
+	void absorb_claims(const player& other) {
+		claims += other.claims;
+		verified += other.verified;
+		mistaken += other.mistaken;
+	}
+
+protected:
+	/**
+	 * search the state on the kept tree if it is there, or on a new tree
+	 * if live is set, the visits are streamed to std::cerr as GoGui live graphics every live milliseconds
+	 */
+	action search(const board& state, size_t flag, size_t N, const node::budget& adapt) {
+		playout_policy policy(playout_flags, playout_tau, patterns.get(), eval);
+		policy.spread(leaf, concurrent ? &pool::shared() : nullptr);
+		std::unique_ptr<node> root = tree ? tree->subtree(state) : nullptr;
+		if (!root) root.reset(new node(state));
+		auto last = std::chrono::steady_clock::now();
+		auto monitor = [&](const node& n) {
+			auto now = std::chrono::steady_clock::now();
+			if (now - last < std::chrono::milliseconds(live)) return;
+			std::cerr << "gogui-gfx:\n" << gfx(n, "visits") << "\n\n" << std::flush;
+			last = now;
+		};
+		action result = run_mcts(*root, flag, count, N, engine, policy, tree_shape, adapt,
+			deterministic ? nullptr : cache.get(), book.get(),
+			live ? std::function<void(const node&)>(monitor) : nullptr);
+		keep(std::move(root));
+		return result;
+	}
+
+	/**
+	 * keep the tree of a finished search, and record it to the cache and the tree file
+	 */
+	void keep(std::unique_ptr<node> root) {
+		last_value = root->win_rate();
+		if (cache) root->record(*cache);
+		tree = std::move(root);
+		if (meta.find("tree") != meta.end())
+			save_tree(property("tree"));
+	}
+
+	/**
+	 * run MCTS, or a slice of it, on the root with the selection policy of this player,
+	 * which is chosen once per search or slice
+	 */
+	template<typename... args>
+	action run_mcts(node& root, args&&... params) const {
+		if (selection == "tuned") return root.run_mcts<node::ucb1_tuned>(std::forward<args>(params)...);
+		if (selection == "puct") return root.run_mcts<node::puct>(std::forward<args>(params)...);
+		if (selection == "thompson") return root.run_mcts<node::thompson>(std::forward<args>(params)...);
+		return root.run_mcts<node::ucb1>(std::forward<args>(params)...);
+	}
+
+	template<typename... args>
+	bool run_slice(node& root, args&&... params) const {
+		if (selection == "tuned") return root.run_slice<node::ucb1_tuned>(std::forward<args>(params)...);
+		if (selection == "puct") return root.run_slice<node::puct>(std::forward<args>(params)...);
+		if (selection == "thompson") return root.run_slice<node::thompson>(std::forward<args>(params)...);
+		return root.run_slice<node::ucb1>(std::forward<args>(params)...);
+	}
+
+	/**
+	 * search independent trees on the shared pool, each with N / trees cycles and its own seed,
+	 * and pick the move with the most visits summed over all trees
+	 *
+	 * the trees are fixed lanes whose seeds are drawn from the engine in order, and their statistics
+	 * are summed in lane order with ties broken by wins and then by the smaller move, so the result
+	 * does not depend on the number of threads nor on their timing (unless the cache is read)
+	 * the trees run as a group of the pool, so a search never runs another game or server session while it waits
+	 */
+	action run_parallel(const board& state, size_t flag, size_t N) {
+		typedef std::array<size_t, board::size_x * board::size_y> counts;
+		typedef std::array<double, board::size_x * board::size_y> sums;
+		std::vector<unsigned> seeds(trees);
+		for (unsigned& seed : seeds) seed = engine();
+		std::vector<counts> visits(trees, counts());
+		std::vector<sums> wins(trees, sums());
+		pool::shared().group(trees, [&](size_t k) {
+			std::default_random_engine local(seeds[k]);
+			playout_policy policy(playout_flags, playout_tau, patterns.get(), eval);
+			policy.spread(leaf, concurrent ? &pool::shared() : nullptr);
+			node root(state);
+			run_mcts(root, flag, count, N / trees, local, policy, tree_shape, search_budget,
+				deterministic ? nullptr : cache.get(), book.get());
+			if (cache) root.record(*cache);
+			for (const node::edge& ch : root.children()) {
+				visits[k][ch.move()] = ch.visits();
+				wins[k][ch.move()] = ch.wins();
+			}
+		});
+		counts visit = {};
+		sums win = {};
+		for (size_t k = 0; k < trees; k++) {
+			for (size_t i = 0; i < visit.size(); i++) {
+				visit[i] += visits[k][i];
+				win[i] += wins[k][i];
+			}
+		}
+		int best = 0;
+		for (int i = 1; i < int(visit.size()); i++)
+			if (visit[i] > visit[best] || (visit[i] == visit[best] && win[i] > win[best])) best = i;
+		if (visit[best] == 0) return action();
+		last_value = float(win[best]) / visit[best];
+		return action::place(best, state.info().who_take_turns);
+	}
+
+	/**
+	 * a pondering in progress, see start_ponder()
+	 */
+	struct pondering {
+		pondering(const playout_policy& policy, size_t N) : policy(policy), search(N), last(std::chrono::steady_clock::now()) {}
+		std::unique_ptr<node> root;
+		playout_policy policy;
+		node::budget adapt;
+		node::progress search;
+		std::chrono::steady_clock::time_point last; // of the live graphics
+	};
+
 private:
 	std::vector<action::place> space;
 	board::piece_type who;
 	int count = 0;
 	double total_time = 0;
+	unsigned playout_flags = playout_policy::random;
+	float playout_tau = 1;
+	float eval = 0; // weight of the static evaluation in the value of a leaf
+	size_t leaf = 1; // playouts from every new leaf
+	bool concurrent = false; // run the playouts of a leaf on the shared pool
+	node::shape tree_shape;
+	std::string selection = "ucb1"; // ucb1, tuned (UCB1-Tuned), puct, or thompson
+	node::budget search_budget;
+	size_t trees = 1;
+	std::unique_ptr<node> tree;
+	std::unique_ptr<pondering> pending;
+	std::unique_ptr<position_cache> cache;
+	std::unique_ptr<position_book> book;
+	std::unique_ptr<pattern_weights> patterns;
+	bool deterministic = false; // do not read the cache, whose content depends on timing
+	size_t live = 0;
+	float last_value = 0.5;
+	float resign = 0;
+	size_t adjudicate = 0;
+	float verify = 0;
+	bool claimed = false;
+	size_t claims = 0, verified = 0, mistaken = 0;
 };
 
 class noob_player : public random_agent {
@@ -0,0 +1,336 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * archive.h: Parallel replay and verification of saved game archives
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <cstring>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "board.h"
+#include "pool.h"
+
+/**
+ * verifier of the archives saved by --save, i.e., one episode per line as written by statistic
+ *
+ * the file is memory-mapped and cut into chunks at line boundaries, and the chunks are parsed
+ * by the shared workers without any stream or allocation per line; every episode is replayed
+ * through board::place to verify that all its moves are legal and that the recorded winner is
+ * the player who made the last move; the partial statistics of the chunks are merged at the end
+ */
+class archive {
+public:
+	archive(const std::string& path) : path(path), text(nullptr), length(0) {
+		int fd = ::open(path.c_str(), O_RDONLY);
+		struct stat st;
+		if (fd >= 0 && ::fstat(fd, &st) == 0 && st.st_size > 0) {
+			void* addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (addr != MAP_FAILED) {
+				text = static_cast<const char*>(addr);
+				length = st.st_size;
+				::madvise(addr, length, MADV_SEQUENTIAL);
+			}
+		}
+		if (fd >= 0) ::close(fd);
+	}
+	~archive() {
+		if (text) ::munmap(const_cast<char*>(text), length);
+	}
+	archive(const archive&) = delete;
+	archive& operator =(const archive&) = delete;
+
+	bool is_open() const { return text != nullptr; }
+
+public:
+	/**
+	 * the statistics of (a part of) an archive
+	 */
+	struct summary {
+		size_t lines = 0;
+		size_t games = 0;
+		size_t moves = 0;
+		size_t malformed = 0;
+		size_t illegal = 0;
+		size_t wrong_winner = 0;
+		size_t early = 0; // valid games where the loser still had a legal move, e.g., resigned
+		size_t black_wins = 0;
+		std::vector<size_t> length = std::vector<size_t>(board::size_x * board::size_y + 1);
+		std::vector<size_t> time[2] = { std::vector<size_t>(buckets), std::vector<size_t>(buckets) };
+		uint64_t total_time[2] = { 0, 0 };
+		std::vector<std::pair<size_t, std::string>> errors; // the first errors with their line numbers
+
+		size_t valid() const { return games - malformed - illegal - wrong_winner; }
+
+		void merge(const summary& part) {
+			for (const auto& e : part.errors)
+				if (errors.size() < max_errors) errors.emplace_back(e.first + lines, e.second);
+			lines += part.lines;
+			games += part.games;
+			moves += part.moves;
+			malformed += part.malformed;
+			illegal += part.illegal;
+			wrong_winner += part.wrong_winner;
+			early += part.early;
+			black_wins += part.black_wins;
+			for (size_t i = 0; i < length.size(); i++) length[i] += part.length[i];
+			for (int c = 0; c < 2; c++) {
+				for (size_t i = 0; i < buckets; i++) time[c][i] += part.time[c][i];
+				total_time[c] += part.total_time[c];
+			}
+		}
+	};
+
+	/**
+	 * a valid episode as given to the visitor of verify(), with the moves as board::point::i
+	 */
+	struct game {
+		const int* moves;
+		size_t ply;
+		bool black_won;
+	};
+
+	/**
+	 * verify the whole archive with the given workers
+	 */
+	summary verify(pool& workers) const {
+		std::vector<char> parts;
+		return verify(workers, parts, [](char&, const game&) {});
+	}
+
+	/**
+	 * verify the whole archive, and pass every valid game to visit(parts[k], game) meanwhile,
+	 * where the parts are resized to the number of chunks and chunk k is scanned by one worker
+	 */
+	template<typename part, typename visitor>
+	summary verify(pool& workers, std::vector<part>& parts, visitor visit) const {
+		std::vector<const char*> cuts(1, text);
+		size_t chunks = std::max<size_t>(1, std::min<size_t>(workers.size() * 16, length >> 16));
+		for (size_t k = 1; k < chunks; k++) {
+			const char* p = std::max(cuts.back(), text + length * k / chunks);
+			p = static_cast<const char*>(std::memchr(p, '\n', text + length - p));
+			if (!p) break;
+			cuts.push_back(p + 1);
+		}
+		cuts.push_back(text + length);
+
+		std::vector<summary> sums(cuts.size() - 1);
+		parts.resize(sums.size());
+		workers.parallel(sums.size(), [&](size_t k) {
+			scan(cuts[k], cuts[k + 1], sums[k], [&](const game& g) { visit(parts[k], g); });
+		});
+		summary all;
+		for (const summary& sum : sums) all.merge(sum);
+		return all;
+	}
+
+	/**
+	 * print the report of a verification
+	 *
+	 * the format would be, where the statistics are of the valid games only
+	 * games = 1000 (1000 valid, 0 malformed, 0 illegal, 0 wrong winner, 12 ended early), moves = 35000
+	 * win = 53.5%|46.5%
+	 * length   min = 28, p50 = 35, p90 = 41, max = 52, avg = 35.2
+	 * black    p50 = 12.3, p90 = 20.1, p99 = 35.7, max = 41.2, avg = 13.1 (n = 17600)
+	 *
+	 * where the time percentiles of black and white are in milliseconds and rounded up to
+	 * their histogram buckets, which are at most 1/8 apart
+	 */
+	static void report(std::ostream& out, const summary& sum) {
+		out << "games = " << sum.games << " (" << sum.valid() << " valid, " << sum.malformed << " malformed, "
+		    << sum.illegal << " illegal, " << sum.wrong_winner << " wrong winner, "
+		    << sum.early << " ended early), moves = " << sum.moves << std::endl;
+		size_t played = sum.valid();
+		if (played == 0) return;
+		out << "win = " << (sum.black_wins * 100.0 / played) << "%|"
+		    << ((played - sum.black_wins) * 100.0 / played) << "%" << std::endl;
+
+		auto pct = [](const std::vector<size_t>& hist, size_t n, double q) {
+			size_t rank = std::min(n - 1, size_t(q * n)), seen = 0, i = 0;
+			while ((seen += hist[i]) <= rank) i++;
+			return i;
+		};
+		size_t lo = 0, hi = sum.length.size() - 1;
+		while (!sum.length[lo]) lo++;
+		while (!sum.length[hi]) hi--;
+		out << std::left << std::setw(9) << "length" << std::right;
+		out << "min = " << lo << ", p50 = " << pct(sum.length, played, 0.5) << ", p90 = " << pct(sum.length, played, 0.9)
+		    << ", max = " << hi << ", avg = " << (sum.moves * 1.0 / played) << std::endl;
+
+		const char* color[] = { "black", "white" };
+		for (int c = 0; c < 2; c++) {
+			const std::vector<size_t>& hist = sum.time[c];
+			size_t n = 0, top = 0;
+			for (size_t i = 0; i < buckets; i++) if (hist[i]) n += hist[i], top = i;
+			if (n == 0) continue;
+			auto ms = [](size_t b) { return upper_of(b) / 1000.0; };
+			out << std::left << std::setw(9) << color[c] << std::right;
+			out << "p50 = " << ms(pct(hist, n, 0.5)) << ", p90 = " << ms(pct(hist, n, 0.9))
+			    << ", p99 = " << ms(pct(hist, n, 0.99)) << ", max = " << ms(top)
+			    << ", avg = " << (sum.total_time[c] / 1000.0 / n) << " (n = " << n << ")" << std::endl;
+		}
+		for (const auto& e : sum.errors)
+			out << "line " << e.first << ": " << e.second << std::endl;
+	}
+
+protected:
+	static constexpr size_t buckets = 8 * 40;
+	static constexpr size_t max_errors = 16;
+
+	/**
+	 * the histogram bucket of a latency in microseconds, with 8 buckets per power of two
+	 */
+	static size_t bucket_of(uint64_t us) {
+		if (us < 8) return us;
+		int e = 63 - __builtin_clzll(us);
+		return std::min<size_t>(buckets - 1, (e - 2) * 8 + ((us >> (e - 3)) & 7));
+	}
+	static uint64_t upper_of(size_t b) {
+		if (b < 8) return b;
+		int e = b / 8 + 2;
+		return ((8 + (b & 7) + 1) << (e - 3)) - 1;
+	}
+
+	/**
+	 * parse and replay the lines in [p, end), which starts at a line boundary
+	 */
+	template<typename visitor>
+	void scan(const char* p, const char* end, summary& sum, const visitor& visit) const {
+		while (p < end) {
+			const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+			if (!eol) eol = end;
+			sum.lines++;
+			if (eol > p && !(eol - p == 1 && p[0] == '\r')) check(p, eol, sum, visit);
+			p = eol + 1;
+		}
+	}
+
+	/**
+	 * verify a line of episode, e.g.,
+	 * (;FF[4]...RE[B+R]C[TCG|black:white@1600000000000|black@1600000001234];B[ee]C[12.345];W[dc]...)
+	 */
+	template<typename visitor>
+	void check(const char* line, const char* end, summary& sum, const visitor& visit) const {
+		sum.games++;
+		auto fail = [&](size_t& counter, const std::string& what) {
+			counter++;
+			if (sum.errors.size() < max_errors) sum.errors.emplace_back(sum.lines, what);
+		};
+
+		const char* tag = find(line, end, "C[TCG|");
+		if (!tag) return fail(sum.malformed, "missing C[TCG|...]");
+		const char* open = tag + 6;
+		const char* at = std::find(open, end, '@');
+		const char* colon = std::find(open, at, ':');
+		const char* bar = std::find(at, end, '|');
+		const char* close = bar + 1;
+		const char* at2 = std::find(close, end, '@');
+		const char* rb = std::find(at2, end, ']');
+		if (colon == at || bar == end || at2 == end || rb == end) return fail(sum.malformed, "malformed C[TCG|...]");
+		std::string black_name(open, colon), white_name(colon + 1, at), winner(close, at2);
+
+		board state;
+		std::array<uint64_t, board::size_x * board::size_y> spent;
+		std::array<int, board::size_x * board::size_y> moves;
+		size_t ply = 0;
+		const char* p = rb + 1;
+		for (; p < end && *p == ';'; ply++) {
+			if (end - p < 6 || p[2] != '[' || p[5] != ']' || (p[1] != 'B' && p[1] != 'W'))
+				return fail(sum.malformed, "malformed move at ply " + std::to_string(ply + 1));
+			unsigned who = p[1] == 'B' ? board::black : board::white;
+			int x = p[3] - 'a', y = (board::size_y - 1) - (p[4] - 'a');
+			board::reward res = state.place(x, y, who);
+			if (res != board::legal)
+				return fail(sum.illegal, "illegal move " + std::string(p, 6) + " at ply "
+				                       + std::to_string(ply + 1) + " (" + reason(res) + ")");
+			if (ply < moves.size()) moves[ply] = board::point(x, y).i;
+			p += 6;
+			uint64_t us = 0;
+			if (p < end && *p == 'C') { // C[12.345]
+				if (end - p < 3 || p[1] != '[') return fail(sum.malformed, "malformed time at ply " + std::to_string(ply + 1));
+				uint64_t ms = 0, frac = 0;
+				int digits = -1; // of the fraction, or -1 for an integer record such as C[12]
+				for (p += 2; p < end && *p != ']'; p++) {
+					if (*p == '.') digits = std::max(digits, 0);
+					else if (*p < '0' || *p > '9') continue;
+					else if (digits < 0) ms = ms * 10 + (*p - '0');
+					else if (digits < 3) frac = frac * 10 + (*p - '0'), digits++;
+				}
+				for (; digits >= 0 && digits < 3; digits++) frac *= 10;
+				us = ms * 1000 + frac;
+				p++;
+			}
+			if (ply < spent.size()) spent[ply] = us;
+		}
+		if (p >= end || *p != ')') return fail(sum.malformed, "malformed move at ply " + std::to_string(ply + 1));
+		if (ply == 0) return fail(sum.malformed, "no move");
+
+		bool black_won = (ply % 2 == 1); // the player who cannot move loses
+		if (winner != (black_won ? black_name : white_name))
+			return fail(sum.wrong_winner, "winner " + winner + " but " + (black_won ? black_name : white_name)
+			                            + " made the last move at ply " + std::to_string(ply));
+		const char* re = find(line, tag, "RE[");
+		if (re && re[3] != (black_won ? 'B' : 'W'))
+			return fail(sum.wrong_winner, "RE[" + std::string(1, re[3]) + "+R] mismatches the last move");
+
+		sum.moves += ply;
+		sum.length[std::min(ply, sum.length.size() - 1)]++;
+		sum.black_wins += black_won;
+		for (size_t i = 0; i < ply; i++) {
+			sum.time[i % 2][bucket_of(spent[i])]++;
+			sum.total_time[i % 2] += spent[i];
+		}
+		visit(game{ moves.data(), ply, black_won });
+		for (int i = 0; i < board::size_x * board::size_y; i++) {
+			board after = state;
+			if (after.place(board::point(i)) == board::legal) {
+				sum.early++;
+				break;
+			}
+		}
+	}
+
+	static const char* find(const char* p, const char* end, const char* s) {
+		size_t n = std::strlen(s);
+		for (; end - p >= ptrdiff_t(n); p++) {
+			p = static_cast<const char*>(std::memchr(p, s[0], end - p));
+			if (!p || end - p < ptrdiff_t(n)) return nullptr;
+			if (std::memcmp(p, s, n) == 0) return p;
+		}
+		return nullptr;
+	}
+
+	static const char* reason(board::reward res) {
+		const char* reason[] = {
+			"legal",
+			"illegal_turn",
+			"illegal_pass",
+			"illegal_out_of_range",
+			"illegal_not_empty",
+			"illegal_suicide",
+			"illegal_take",
+			"unknown",
+		};
+		return reason[std::min(-res, 7)];
+	}
+
+private:
+	std::string path;
+	const char* text;
+	size_t length;
+};
+
+constexpr size_t archive::buckets;
+constexpr size_t archive::max_errors;
@@ -0,0 +1,170 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * bitboard.h: Bitboard backend of the board
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <cstdint>
+#include "board.h"
+#include "isa.h"
+
+/**
+ * board with one bit per point for each color, where bit i is board::point(i)
+ *
+ * the neighbors of a set of points are found by shifts, so a block is flooded and its liberties
+ * are found in a few word operations; place() gives exactly the result codes of board::place(),
+ * which is tested by board_fuzzer
+ *
+ * the methods are always inlined, so that a kernel built for an instruction set (see isa.h) also
+ * runs them with the instructions of that set
+ */
+class bitboard {
+public:
+	typedef unsigned __int128 mask;
+
+	bitboard() : stones{ 0, 0 }, who(board::black), last(-1) {}
+	ISA_INLINE explicit bitboard(const board& b) : stones{ 0, 0 }, who(b.info().who_take_turns), last(b.info().last_move.i) {
+		for (int i = 0; i < board::size_x * board::size_y; i++) {
+			board::cell c = b(i);
+			if (c == board::black || c == board::white) stones[c - 1] |= bit(i);
+		}
+	}
+
+public:
+	/**
+	 * place a stone with the same rules and the same result codes as board::place()
+	 */
+	board::reward place(int x, int y, unsigned who = board::unknown) {
+		if (who == -1u) who = this->who;
+		if (who != this->who) return board::illegal_turn;
+		if (x == -1 && y == -1) return board::illegal_pass;
+		if (x < 0 || x >= board::size_x || y < 0 || y >= board::size_y) return board::illegal_out_of_range;
+		mask p = bit(board::point(x, y).i);
+		if (p & hollow()) return board::illegal_out_of_range;
+		if (p & (stones[0] | stones[1])) return board::illegal_not_empty;
+		mask own = stones[who - 1] | p, opp = stones[2 - who];
+		mask empty = empties() & ~p;
+		if (!(neighbors(block(p, own)) & empty)) return board::illegal_suicide;
+		mask near = neighbors(p) & opp;
+		while (near) {
+			mask b = block(near & -near, opp);
+			if (!(neighbors(b) & empty)) return board::illegal_take;
+			near &= ~b;
+		}
+		stones[who - 1] = own;
+		this->who = 3u - who;
+		last = board::point(x, y).i;
+		return board::legal;
+	}
+	board::reward place(const board::point& p, unsigned who = board::unknown) {
+		return place(p.x, p.y, who);
+	}
+
+	/**
+	 * get the legal moves of the given side, the side to move by default
+	 * a move is illegal if it fills the last liberty of an opponent block, or if it has neither
+	 * an empty neighbor nor an own neighbor block with another liberty
+	 */
+	ISA_INLINE mask legal(unsigned who = board::unknown) const {
+		if (who == -1u) who = this->who;
+		mask own = stones[who - 1], opp = stones[2 - who];
+		mask empty = empties();
+		mask breath = neighbors(empty), taken = 0;
+		for (mask left = own | opp; left; ) {
+			mask seed = left & -left;
+			mask b = block(seed, (seed & own) ? own : opp);
+			mask libs = neighbors(b) & empty;
+			if (b & opp) {
+				if (single(libs)) taken |= libs;
+			} else if (!single(libs)) {
+				breath |= neighbors(b);
+			}
+			left &= ~b;
+		}
+		return empty & breath & ~taken;
+	}
+
+	/**
+	 * play a move that is known to be legal, e.g., one of legal(), without checking it
+	 */
+	ISA_INLINE void play(int i) {
+		stones[who - 1] |= bit(i);
+		who = 3u - who;
+		last = i;
+	}
+
+	ISA_INLINE mask empties() const { return ~(stones[0] | stones[1] | hollow()) & full(); }
+
+	unsigned operator ()(int i) const {
+		mask p = bit(i);
+		return (stones[0] & p) ? board::black : (stones[1] & p) ? board::white : (hollow() & p) ? board::hollow : board::empty;
+	}
+	ISA_INLINE mask of(unsigned who) const { return stones[who - 1]; }
+	unsigned who_take_turns() const { return who; }
+	int last_move() const { return last; }
+
+	/**
+	 * check whether the state is the same as that of a reference board
+	 */
+	bool matches(const board& b) const {
+		for (int i = 0; i < board::size_x * board::size_y; i++)
+			if ((*this)(i) != b(i)) return false;
+		return who == b.info().who_take_turns && last == b.info().last_move.i;
+	}
+
+	ISA_INLINE static int count(mask m) {
+		return __builtin_popcountll(uint64_t(m)) + __builtin_popcountll(uint64_t(m >> 64));
+	}
+	ISA_INLINE static int first(mask m) {
+		return uint64_t(m) ? __builtin_ctzll(uint64_t(m)) : 64 + __builtin_ctzll(uint64_t(m >> 64));
+	}
+	ISA_INLINE static mask bit(int i) { return mask(1) << i; }
+
+	ISA_INLINE static mask neighbors(mask m) {
+		return (((m << 1) & ~bottom()) | ((m >> 1) & ~top()) | (m << board::size_y) | (m >> board::size_y)) & full();
+	}
+
+	/**
+	 * flood the block of the seed within the stones
+	 */
+	ISA_INLINE static mask block(mask seed, mask stones) {
+		for (mask grown; (grown = (neighbors(seed) & stones) | seed) != seed; seed = grown);
+		return seed;
+	}
+
+	ISA_INLINE static mask hollow() {
+		static const mask m = []() {
+			mask m = 0;
+			for (int i = 0; i < board::size_x * board::size_y; i++)
+				if (board()(i) == board::hollow) m |= bit(i);
+			return m;
+		}();
+		return m;
+	}
+
+protected:
+	ISA_INLINE static mask full() { return (mask(1) << (board::size_x * board::size_y)) - 1; }
+	ISA_INLINE static bool single(mask m) { return m && !(m & (m - 1)); }
+
+	/**
+	 * the points with y == 0, used to cut the shifts that wrap around the columns
+	 */
+	ISA_INLINE static mask bottom() {
+		static const mask m = []() {
+			mask m = 0;
+			for (int x = 0; x < board::size_x; x++) m |= bit(board::point(x, 0).i);
+			return m;
+		}();
+		return m;
+	}
+	ISA_INLINE static mask top() { return bottom() << (board::size_y - 1); }
+
+private:
+	mask stones[2];
+	unsigned who;
+	int last;
+};
@@ -10,6 +10,7 @@
 #pragma once
 #include <array>
 #include <list>
+#include <cstdint>
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
@@ -41,6 +42,9 @@
  *
  * for 9x9 Hollow NoGo, the center 3x3 is hollow (hollow but not empty, cannot be counted as liberty),
  * i.e., there are also borders at the center of the board
+ *
+ * the board also keeps the 3x3 pattern code of every point, see pattern(); the codes are updated by
+ * place() and rebuilt by the transforms, so refresh() must be called after writing the stones directly
  */
 class board {
 public:
@@ -66,6 +70,7 @@ public:
 	typedef uint32_t cell;
 	typedef std::array<cell, size_y> column;
 	typedef std::array<column, size_x> grid;
+	typedef std::array<uint16_t, size_x * size_y> patterns;
 	struct data {
 		piece_type who_take_turns;
 		point last_move;
@@ -73,8 +78,8 @@ public:
 	typedef int reward;
 
 public:
-	board() : stone(initial()), attr({piece_type::black, -1}) {}
-	board(const grid& b, const data& d) : stone(b), attr(d) {}
+	board() : stone(initial()), code(initial_patterns()), attr({piece_type::black, -1}) {}
+	board(const grid& b, const data& d) : stone(b), attr(d) { refresh(); }
 	board(const board& b) = default;
 	board& operator =(const board& b) = default;
 
@@ -121,18 +126,26 @@ public:
 		point p_min(0, 0), p_max(size_x - 1, size_y - 1);
 		if (x < p_min.x || x > p_max.x || y < p_min.y || y > p_max.y) return nogo_move_result::illegal_out_of_range;
 		if (board::initial()[x][y] == piece_type::hollow)             return nogo_move_result::illegal_out_of_range;
-		board test = *this;
-		if (test[x][y] != piece_type::empty) return nogo_move_result::illegal_not_empty;
-		test[x][y] = who; // try put a piece first
-		if (test.check_liberty(x, y, who) == 0) return nogo_move_result::illegal_suicide;
+		if (stone[x][y] != piece_type::empty) return nogo_move_result::illegal_not_empty;
+		stone[x][y] = who; // try put a piece first, and take it back if the move is illegal
+		reward result = nogo_move_result::legal;
 		unsigned opp = 3u - who;
-		if (x > p_min.x && test.check_liberty(x - 1, y, opp) == 0) return nogo_move_result::illegal_take;
-		if (x < p_max.x && test.check_liberty(x + 1, y, opp) == 0) return nogo_move_result::illegal_take;
-		if (y > p_min.y && test.check_liberty(x, y - 1, opp) == 0) return nogo_move_result::illegal_take;
-		if (y < p_max.y && test.check_liberty(x, y + 1, opp) == 0) return nogo_move_result::illegal_take;
-		stone[x][y] = who; // is legal move!
+		if (check_liberty(x, y, who) == 0) result = nogo_move_result::illegal_suicide;
+		else if (x > p_min.x && check_liberty(x - 1, y, opp) == 0) result = nogo_move_result::illegal_take;
+		else if (x < p_max.x && check_liberty(x + 1, y, opp) == 0) result = nogo_move_result::illegal_take;
+		else if (y > p_min.y && check_liberty(x, y - 1, opp) == 0) result = nogo_move_result::illegal_take;
+		else if (y < p_max.y && check_liberty(x, y + 1, opp) == 0) result = nogo_move_result::illegal_take;
+		if (result != nogo_move_result::legal) {
+			stone[x][y] = piece_type::empty;
+			return result;
+		}
+		point p(x, y); // is legal move!
+		for (int k = 0; k < 8; k++) { // the new stone is the neighbor 7 - k of its neighbor k
+			int n = around()[p.i][k];
+			if (n != -1) code[n] |= who << (2 * (7 - k));
+		}
 		attr.who_take_turns = static_cast<piece_type>(opp);
-		attr.last_move = point(x, y);
+		attr.last_move = p;
 		return nogo_move_result::legal;
 	}
 	reward place(const point& p, unsigned who = piece_type::unknown) {
@@ -174,12 +187,37 @@ public:
 		return liberty;
 	}
 
+	/**
+	 * get the 3x3 pattern code of a point from the view of the given side, in O(1)
+	 * the code packs the 8 neighbors with 2 bits each, as empty = 0, own = 1, opponent = 2,
+	 * or off-board and hollow = 3, where neighbor k is at offset around_offset[k]
+	 */
+	unsigned pattern(unsigned i, unsigned who = piece_type::black) const {
+		unsigned c = code[i]; // kept from the view of black, so white swaps the own and the opponent
+		return who == piece_type::white ? c ^ (((c ^ (c >> 1)) & 0x5555u) * 3u) : c;
+	}
+
+	/**
+	 * rebuild the pattern codes of all points from the stones
+	 */
+	void refresh() {
+		for (int i = 0; i < size_x * size_y; i++) {
+			unsigned c = 0;
+			for (int k = 0; k < 8; k++) {
+				int n = around()[i][k];
+				c |= (n != -1 ? stone[n / size_y][n % size_y] & 3u : unsigned(piece_type::hollow)) << (2 * k);
+			}
+			code[i] = c;
+		}
+	}
+
 	void transpose() {
 		for (int x = 0; x < size_x; x++) {
 			for (int y = x + 1; y < size_y; y++) {
 				std::swap(stone[x][y], stone[y][x]);
 			}
 		}
+		refresh();
 	}
 
 	void reflect_horizontal() {
@@ -188,6 +226,7 @@ public:
 				std::swap(stone[x][y], stone[size_x - 1 - x][y]);
 			}
 		}
+		refresh();
 	}
 
 	void reflect_vertical() {
@@ -196,6 +235,7 @@ public:
 				std::swap(stone[x][y], stone[x][size_y - 1 - y]);
 			}
 		}
+		refresh();
 	}
 
 	/**
@@ -215,6 +255,57 @@ public:
 	void rotate_left() { transpose(); reflect_horizontal(); } // counterclockwise
 	void reverse() { reflect_horizontal(); reflect_vertical(); }
 
+	/**
+	 * map a point by one of the 8 symmetries of the board, where s == 0 is the identity
+	 * bit 0 of s transposes, then bit 1 reflects horizontally, then bit 2 reflects vertically
+	 */
+	static point symmetric(const point& p, int s) {
+		int x = p.x, y = p.y;
+		if (s & 1) std::swap(x, y);
+		if (s & 2) x = size_x - 1 - x;
+		if (s & 4) y = size_y - 1 - y;
+		return point(x, y);
+	}
+
+	/**
+	 * get the symmetry that maps the points back, i.e., symmetric(symmetric(p, s), inverse(s)) == p
+	 * the reflections swap their axes when combined with the transpose
+	 */
+	static int inverse(int s) {
+		return (s & 1) ? (1 | ((s & 2) << 1) | ((s & 4) >> 1)) : s;
+	}
+
+	/**
+	 * get the Zobrist hash of the position, including the side to move
+	 * the keys are fixed, so the hash is the same across processes
+	 */
+	uint64_t hash() const {
+		uint64_t h = zobrist()[size_x * size_y][attr.who_take_turns & 3];
+		for (int x = 0; x < size_x; x++)
+			for (int y = 0; y < size_y; y++)
+				h ^= zobrist()[x * size_y + y][stone[x][y] & 3];
+		return h;
+	}
+
+	/**
+	 * get the smallest hash of the 8 symmetric positions, which is shared by all of them
+	 * the symmetry giving the smallest hash is stored to sym if it is not null
+	 */
+	uint64_t canonical_hash(int* sym = nullptr) const {
+		std::array<uint64_t, 8> h;
+		h.fill(zobrist()[size_x * size_y][attr.who_take_turns & 3]);
+		for (int x = 0; x < size_x; x++) {
+			for (int y = 0; y < size_y; y++) {
+				cell c = stone[x][y] & 3;
+				if (c == piece_type::empty || c == piece_type::hollow) continue;
+				for (int s = 0; s < 8; s++) h[s] ^= zobrist()[symmetric(point(x, y), s).i][c];
+			}
+		}
+		int best = std::min_element(h.begin(), h.end()) - h.begin();
+		if (sym) *sym = best;
+		return h[best];
+	}
+
 public:
 	friend std::ostream& operator <<(std::ostream& out, const board& b) {
 		std::ios ff(nullptr);
@@ -259,11 +350,13 @@ public:
 					b[x][y] = static_cast<piece_type>(type);
 				} else {
 					in.setstate(std::ios_base::failbit);
+					b.refresh();
 					return in;
 				}
 			}
 		}
 		for (int x = 0; x < size_x; x++) in >> token; /* skip X */
+		b.refresh();
 		return in;
 	}
 	friend std::ostream& operator <<(std::ostream& out, const point& p) {
@@ -276,15 +369,70 @@ public:
 	}
 
 protected:
+	/**
+	 * the Zobrist keys of each point and piece, and of the side to move as the last entry
+	 * empty and hollow points have zero keys
+	 */
+	typedef std::array<std::array<uint64_t, 4>, size_x * size_y + 1> zobrist_keys;
+	static const zobrist_keys& zobrist() {
+		static const zobrist_keys keys = generate_zobrist();
+		return keys;
+	}
+	static zobrist_keys generate_zobrist() {
+		zobrist_keys keys;
+		uint64_t seed = 0x4e6f476f5a6f6272ull; // splitmix64
+		for (auto& key : keys) {
+			for (int c = 0; c < 4; c++) {
+				uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+				z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+				z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+				key[c] = z ^ (z >> 31);
+			}
+			key[piece_type::empty] = key[piece_type::hollow] = 0;
+		}
+		return keys;
+	}
+
+public:
+	/**
+	 * the offsets of the 8 neighbors of a pattern code, where neighbor 7 - k is at the opposite of neighbor k
+	 */
+	static constexpr int around_offset[8][2] = { {-1, -1}, {0, -1}, {1, -1}, {-1, 0}, {1, 0}, {-1, 1}, {0, 1}, {1, 1} };
+
+protected:
+	/**
+	 * the index of the neighbor k of every point, or -1 if it is off the board
+	 */
+	typedef std::array<std::array<int8_t, 8>, size_x * size_y> neighbor_table;
+	static const neighbor_table& around() {
+		static const neighbor_table table = []() {
+			neighbor_table table;
+			for (int i = 0; i < size_x * size_y; i++) {
+				point p(i);
+				for (int k = 0; k < 8; k++) {
+					int x = p.x + around_offset[k][0], y = p.y + around_offset[k][1];
+					table[i][k] = (x >= 0 && x < size_x && y >= 0 && y < size_y) ? point(x, y).i : -1;
+				}
+			}
+			return table;
+		}();
+		return table;
+	}
+
 	static const grid& initial() { static grid stone; return stone; }
+	static const patterns& initial_patterns() { static patterns code; return code; }
 	static __attribute__((constructor)) void init_initial_scheme() {
 		grid& stone = const_cast<grid&>(initial());
 		point hollow((size_x - hollow_x) / 2, (size_y - hollow_y) / 2);
 		for (int x = hollow.x; x < hollow.x + hollow_x; x++)
 			for (int y = hollow.y; y < hollow.y + hollow_y; y++)
 				stone[x][y] = piece_type::hollow;
+		const_cast<patterns&>(initial_patterns()) = board(stone, { piece_type::black, -1 }).code;
 	}
 private:
 	grid stone;
+	patterns code; // the pattern code of every point from the view of black, see pattern()
 	data attr;
 };
+
+constexpr int board::around_offset[8][2];
@@ -0,0 +1,240 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * book.h: Position statistics database built from game archives
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "board.h"
+#include "archive.h"
+#include "pool.h"
+
+/**
+ * read-only memory-mapped table of the positions played in game archives
+ *
+ * every record is keyed by board::canonical_hash(), and keeps the number of games that reached the
+ * position, how many of them black won, and the most played continuations; the continuations are
+ * stored in the coordinates of the canonical symmetry, and are mapped back to the queried position;
+ * the records are sorted by their keys, so that a lookup is a binary search over the mapped file
+ */
+class position_book {
+public:
+	/**
+	 * open a book file built by build(), or throw std::runtime_error if the file cannot be used
+	 */
+	position_book(const std::string& path, size_t warm = 16)
+		: warm(warm), table(nullptr), count(0), length(0) {
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) throw std::runtime_error("cannot open book: " + path);
+		struct stat st;
+		header head;
+		bool ok = ::fstat(fd, &st) == 0
+		       && ::pread(fd, &head, sizeof(head), 0) == sizeof(head)
+		       && std::memcmp(head.magic, book_magic, sizeof(head.magic)) == 0
+		       && head.version == book_version
+		       && st.st_size >= off_t(sizeof(header) + head.count * sizeof(record));
+		if (ok) {
+			count = head.count;
+			length = sizeof(header) + head.count * sizeof(record);
+			void* addr = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+			if (addr != MAP_FAILED) table = reinterpret_cast<const record*>(static_cast<const char*>(addr) + sizeof(header));
+		}
+		::close(fd);
+		if (!table) throw std::runtime_error("invalid book: " + path);
+	}
+	~position_book() {
+		::munmap(const_cast<char*>(reinterpret_cast<const char*>(table) - sizeof(header)), length);
+	}
+	position_book(const position_book&) = delete;
+	position_book& operator =(const position_book&) = delete;
+
+public:
+	/**
+	 * a continuation of a position, where wins are of the side who plays the move
+	 */
+	struct continuation {
+		int move;
+		uint32_t games;
+		uint32_t wins;
+	};
+
+	/**
+	 * the statistics of a position, with its continuations in the coordinates of the position,
+	 * which are sorted by the number of games
+	 */
+	struct entry {
+		uint32_t games = 0;
+		uint32_t black_wins = 0;
+		std::vector<continuation> next;
+	};
+
+	/**
+	 * look up the statistics of a position, return false if it is not in the book
+	 */
+	bool find(const board& state, entry& out) const {
+		int sym;
+		const record* rec = lookup(state.canonical_hash(&sym));
+		if (!rec) return false;
+		out.games = rec->games;
+		out.black_wins = rec->black_wins;
+		out.next.clear();
+		for (const stored& s : rec->next) {
+			if (s.move == no_move) break;
+			out.next.push_back({ board::symmetric(board::point(s.move), board::inverse(sym)).i, s.games, s.wins });
+		}
+		return true;
+	}
+
+	/**
+	 * look up only the number of games and black wins of a position
+	 */
+	bool find(const board& state, uint32_t& games, uint32_t& black_wins) const {
+		const record* rec = lookup(state.canonical_hash());
+		if (!rec) return false;
+		games = rec->games;
+		black_wins = rec->black_wins;
+		return true;
+	}
+
+	size_t size() const { return count; }
+
+	/**
+	 * build a book from the valid games of the archives, keeping the positions reached by at least
+	 * min_games games, return the number of positions written, or throw std::runtime_error on failure
+	 */
+	static size_t build(const std::vector<std::string>& archives, const std::string& path, pool& workers,
+			size_t min_games = 2) {
+		std::unordered_map<uint64_t, tally> all;
+		for (const std::string& name : archives) {
+			archive games(name);
+			if (!games.is_open()) throw std::runtime_error("cannot open archive: " + name);
+			std::vector<std::unordered_map<uint64_t, tally>> parts;
+			games.verify(workers, parts, [](std::unordered_map<uint64_t, tally>& part, const archive::game& g) {
+				board state;
+				for (size_t i = 0; i <= g.ply; i++) {
+					int sym;
+					tally& t = part[state.canonical_hash(&sym)];
+					t.games++;
+					t.black_wins += g.black_won;
+					if (i == g.ply) break;
+					bool mover_won = (i % 2 == 0) == g.black_won;
+					t.add(board::symmetric(board::point(g.moves[i]), sym).i, 1, mover_won);
+					state.place(g.moves[i]);
+				}
+			});
+			for (auto& part : parts) {
+				for (auto& kv : part) all[kv.first].merge(kv.second);
+				part.clear();
+			}
+		}
+
+		std::vector<record> records;
+		for (auto& kv : all) {
+			if (kv.second.games < min_games) continue;
+			record rec;
+			rec.key = kv.first;
+			rec.games = kv.second.games;
+			rec.black_wins = kv.second.black_wins;
+			std::vector<stored>& next = kv.second.next;
+			std::stable_sort(next.begin(), next.end(), [](const stored& a, const stored& b) { return a.games > b.games; });
+			for (size_t i = 0; i < max_next; i++)
+				rec.next[i] = i < next.size() ? next[i] : stored{ no_move, {}, 0, 0 };
+			records.push_back(rec);
+		}
+		std::sort(records.begin(), records.end(), [](const record& a, const record& b) { return a.key < b.key; });
+
+		header head;
+		std::memcpy(head.magic, book_magic, sizeof(head.magic));
+		head.version = book_version;
+		head.reserved = 0;
+		head.count = records.size();
+		std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char*>(&head), sizeof(head));
+		out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(record));
+		if (!out) throw std::runtime_error("cannot write book: " + path);
+		return records.size();
+	}
+
+	/**
+	 * the most visits that a position in the book may give to a new node as its prior
+	 */
+	size_t warm;
+
+protected:
+	static constexpr size_t max_next = 4;
+	static constexpr uint8_t no_move = 0xff;
+
+	struct header {
+		char magic[8];
+		uint32_t version;
+		uint32_t reserved;
+		uint64_t count;
+	};
+	struct stored {
+		uint8_t move;
+		uint8_t reserved[3];
+		uint32_t games;
+		uint32_t wins;
+	};
+	struct record { // 64 bytes
+		uint64_t key;
+		uint32_t games;
+		uint32_t black_wins;
+		stored next[max_next];
+	};
+
+	/**
+	 * the statistics of a position while building a book
+	 */
+	struct tally {
+		uint32_t games = 0;
+		uint32_t black_wins = 0;
+		std::vector<stored> next;
+
+		void add(int move, uint32_t games, uint32_t wins) {
+			auto it = std::find_if(next.begin(), next.end(), [=](const stored& s) { return s.move == move; });
+			if (it == next.end()) it = next.insert(next.end(), stored{ uint8_t(move), {}, 0, 0 });
+			it->games += games;
+			it->wins += wins;
+		}
+		void merge(const tally& t) {
+			games += t.games;
+			black_wins += t.black_wins;
+			for (const stored& s : t.next) add(s.move, s.games, s.wins);
+		}
+	};
+
+	const record* lookup(uint64_t key) const {
+		const record* it = std::lower_bound(table, table + count, key,
+			[](const record& rec, uint64_t key) { return rec.key < key; });
+		return (it != table + count && it->key == key) ? it : nullptr;
+	}
+
+	static constexpr char book_magic[8] = { 'N', 'O', 'G', 'O', 'B', 'O', 'O', 'K' };
+	static constexpr uint32_t book_version = 1;
+
+private:
+	const record* table;
+	size_t count;
+	size_t length;
+};
+
+constexpr size_t position_book::max_next;
+constexpr uint8_t position_book::no_move;
+constexpr char position_book::book_magic[8];
+constexpr uint32_t position_book::book_version;
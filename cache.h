@@ -0,0 +1,144 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * cache.h: Persistent position-value cache shared across games and processes
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "board.h"
+
+/**
+ * memory-mapped hash table of position statistics
+ *
+ * the file is a fixed-size open-addressing table keyed by board::canonical_hash(), where every slot
+ * sums up the visits and the wins (for the side who moved into the position) of all recorded searches;
+ * slots are claimed and updated by atomic operations only, so processes can share the same file
+ */
+class position_cache {
+public:
+	/**
+	 * open or create the cache file with the given number of slots
+	 * an existing file keeps its own size; throw std::runtime_error if the file cannot be used
+	 */
+	position_cache(const std::string& path, size_t slots = 1 << 20, size_t warm = 16)
+		: warm(warm), table(nullptr), slots(0), length(0) {
+		int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+		if (fd < 0) throw std::runtime_error("cannot open cache: " + path);
+		::flock(fd, LOCK_EX); // only one process may initialize the file
+		struct stat st;
+		header head;
+		bool ok = (::fstat(fd, &st) == 0);
+		if (ok && st.st_size == 0) {
+			std::memcpy(head.magic, cache_magic, sizeof(head.magic));
+			head.version = cache_version;
+			head.slots = slots;
+			ok = ::ftruncate(fd, sizeof(header) + slots * sizeof(slot)) == 0
+			  && ::pwrite(fd, &head, sizeof(head), 0) == sizeof(head);
+		} else if (ok) {
+			ok = ::pread(fd, &head, sizeof(head), 0) == sizeof(head)
+			  && std::memcmp(head.magic, cache_magic, sizeof(head.magic)) == 0
+			  && head.version == cache_version
+			  && st.st_size >= off_t(sizeof(header) + head.slots * sizeof(slot));
+		}
+		::flock(fd, LOCK_UN);
+		if (ok) {
+			this->slots = head.slots;
+			length = sizeof(header) + head.slots * sizeof(slot);
+			void* addr = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (addr != MAP_FAILED) table = reinterpret_cast<slot*>(static_cast<char*>(addr) + sizeof(header));
+		}
+		::close(fd);
+		if (!table) throw std::runtime_error("invalid cache: " + path);
+	}
+	~position_cache() {
+		::munmap(reinterpret_cast<char*>(table) - sizeof(header), length);
+	}
+	position_cache(const position_cache&) = delete;
+	position_cache& operator =(const position_cache&) = delete;
+
+public:
+	/**
+	 * look up the statistics of a position, return false if it is not recorded
+	 */
+	bool find(const board& state, uint64_t& visits, double& wins) const {
+		uint64_t key = key_of(state);
+		for (size_t i = 0; i < max_probe; i++) {
+			const slot& s = table[(key + i) % slots];
+			uint64_t k = __atomic_load_n(&s.key, __ATOMIC_ACQUIRE);
+			if (k == 0) return false;
+			if (k != key) continue;
+			visits = __atomic_load_n(&s.visits, __ATOMIC_RELAXED);
+			wins = __atomic_load_n(&s.wins, __ATOMIC_RELAXED) / double(win_scale);
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	 * add the statistics of a search to a position, return false if the table is too crowded
+	 */
+	bool add(const board& state, uint64_t visits, double wins) {
+		uint64_t key = key_of(state);
+		for (size_t i = 0; i < max_probe; i++) {
+			slot& s = table[(key + i) % slots];
+			uint64_t k = __atomic_load_n(&s.key, __ATOMIC_ACQUIRE);
+			if (k == 0 && __atomic_compare_exchange_n(&s.key, &k, key, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+				k = key;
+			if (k != key) continue;
+			__atomic_fetch_add(&s.visits, visits, __ATOMIC_RELAXED);
+			__atomic_fetch_add(&s.wins, uint64_t(wins * win_scale + 0.5), __ATOMIC_RELAXED);
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	 * the most visits that a recorded position may give to a new node as its prior
+	 */
+	size_t warm;
+
+protected:
+	struct header {
+		char magic[8];
+		uint32_t version;
+		uint32_t reserved;
+		uint64_t slots;
+	};
+	struct slot {
+		uint64_t key;
+		uint64_t visits;
+		uint64_t wins; // fixed point with win_scale
+	};
+
+	static uint64_t key_of(const board& state) {
+		uint64_t key = state.canonical_hash();
+		return key ? key : 1; // zero marks an empty slot
+	}
+
+	static constexpr char cache_magic[8] = { 'N', 'O', 'G', 'O', 'P', 'C', 'A', 'C' };
+	static constexpr uint32_t cache_version = 1;
+	static constexpr uint64_t win_scale = 256;
+	static constexpr size_t max_probe = 32;
+
+private:
+	slot* table;
+	size_t slots;
+	size_t length;
+};
+
+constexpr char position_cache::cache_magic[8];
+constexpr uint32_t position_cache::cache_version;
+constexpr uint64_t position_cache::win_scale;
+constexpr size_t position_cache::max_probe;
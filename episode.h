@@ -15,6 +15,9 @@
 #include <sstream>
 #include <chrono>
 #include <numeric>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
 #include "board.h"
 #include "action.h"
 #include "agent.h"
@@ -42,12 +45,12 @@ public:
 	bool apply_action(action move) {
 		board::reward reward = move.apply(state());
 		if (reward != board::legal) return false;
-		ep_moves.emplace_back(move, reward, millisec() - ep_time);
+		ep_moves.emplace_back(move, reward, microsec() - ep_time);
 		ep_score += reward;
 		return true;
 	}
 	agent& take_turns(agent& black, agent& white) {
-		ep_time = millisec();
+		ep_time = microsec();
 		return (step() % 2) ? white : black;
 	}
 	agent& last_turns(agent& black, agent& white) {
@@ -67,16 +70,21 @@ public:
 		}
 	}
 
+	/**
+	 * get the time in milliseconds spent by a side, or of the whole episode
+	 */
 	time_t time(unsigned who = -1u) const {
 		time_t time = 0;
 		switch (who) {
 		case board::black:
 		case action::black::type:
 			for (size_t i = 0; i < ep_moves.size(); i += 2) time += ep_moves[i].time;
+			time /= 1000;
 			break;
 		case board::white:
 		case action::white::type:
 			for (size_t i = 1; i < ep_moves.size(); i += 2) time += ep_moves[i].time;
+			time /= 1000;
 			break;
 		case action::place::type:
 		default:
@@ -149,8 +157,61 @@ public:
 		return in;
 	}
 
+	/**
+	 * append a compact binary record of a finished episode, which unpack() reads back, i.e.,
+	 * the tags and the times of the open and the close, then the number of moves, followed by
+	 * the position and the latency (in microseconds) of every move; the integers are little-endian
+	 */
+	void pack(std::string& out) const {
+		for (const meta* m : { &ep_open, &ep_close }) {
+			out.push_back(char(std::min<size_t>(m->tag.size(), 255)));
+			out.append(m->tag, 0, 255);
+			put<uint64_t>(out, m->when);
+		}
+		out.push_back(char(ep_moves.size()));
+		for (const move& mv : ep_moves) {
+			out.push_back(char(action::place(mv.code).position().i));
+			put<uint32_t>(out, mv.time);
+		}
+	}
+
+	/**
+	 * read a record written by pack() from [p, end), and replay its moves from the initial state
+	 * return false if the record is truncated or has an illegal move
+	 */
+	bool unpack(const char*& p, const char* end) {
+		*this = {};
+		for (meta* m : { &ep_open, &ep_close }) {
+			if (p == end || end - p < 1 + uint8_t(*p) + 8) return false;
+			m->tag.assign(p + 1, uint8_t(*p));
+			p += 1 + uint8_t(*p);
+			m->when = get<uint64_t>(p);
+		}
+		if (p == end) return false;
+		size_t n = uint8_t(*p++);
+		if (size_t(end - p) < n * 5) return false;
+		for (size_t i = 0; i < n; i++) {
+			action::place mv(uint8_t(*p++), ep_state.info().who_take_turns);
+			time_t us = get<uint32_t>(p);
+			if (mv.apply(ep_state) != board::legal) return false;
+			ep_moves.emplace_back(mv, board::legal, us);
+		}
+		return true;
+	}
+
 protected:
+	template<typename type> static void put(std::string& out, type value) { // little-endian on any host
+		for (size_t i = 0; i < sizeof(value); i++) out.push_back(char(uint64_t(value) >> (8 * i)));
+	}
+	template<typename type> static type get(const char*& p) {
+		uint64_t value = 0;
+		for (size_t i = 0; i < sizeof(type); i++) value |= uint64_t(uint8_t(*p++)) << (8 * i);
+		return type(value);
+	}
 
+	/**
+	 * a move with its latency in microseconds, which is saved as milliseconds, e.g., C[12.345]
+	 */
 	struct move {
 		action code;
 		board::reward reward;
@@ -160,7 +221,11 @@ protected:
 		operator action() const { return code; }
 		friend std::ostream& operator <<(std::ostream& out, const move& m) {
 			out << m.code;
-			if (m.time) out << "C[" << std::dec << m.time << "]";
+			if (m.time) {
+				char buf[32];
+				std::snprintf(buf, sizeof(buf), "C[%lld.%03lld]", (long long) m.time / 1000, (long long) m.time % 1000);
+				out << buf;
+			}
 			return out;
 		}
 		friend std::istream& operator >>(std::istream& in, move& m) {
@@ -168,9 +233,11 @@ protected:
 			m.reward = 0;
 			m.time = 0;
 			if (in.peek() == 'C') {
+				double ms = 0;
 				in.ignore(2); // C[
-				in >> std::dec >> m.time;
+				in >> std::dec >> ms;
 				in.ignore(1); // ]
+				m.time = time_t(ms * 1000 + 0.5);
 			}
 			return in;
 		}
@@ -196,12 +263,16 @@ protected:
 		auto now = std::chrono::system_clock::now().time_since_epoch();
 		return std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
 	}
+	static time_t microsec() { // for move latency, which must not jump with the wall clock
+		auto now = std::chrono::steady_clock::now().time_since_epoch();
+		return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+	}
 
 private:
 	board ep_state;
 	board::reward ep_score;
 	std::vector<move> ep_moves;
-	time_t ep_time;
+	time_t ep_time; // the start of the current move, see microsec()
 
 	meta ep_open;
 	meta ep_close;
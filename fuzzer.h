@@ -0,0 +1,266 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * fuzzer.h: Differential tester of the bitboard and its kernels against the reference board
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <sstream>
+#include <iostream>
+#include "board.h"
+#include "bitboard.h"
+#include "pattern.h"
+#include "mobility.h"
+#include "pool.h"
+#include "isa.h"
+
+/**
+ * differential tester of the bitboard against the reference board
+ *
+ * every game of the test is a stream of random attempts, drawn from a seed given by the game index:
+ * mostly random points (including occupied, hollow and out-of-range ones), and sometimes a pass or the
+ * wrong color; both backends must give the same result code, and the same state after a legal move
+ *
+ * after every legal move, the legal moves of both sides by bitboard::legal() are checked against
+ * board::place(), the pattern codes kept by the board are checked against those rebuilt from the stones,
+ * and the kernels built on the bitboard are checked against the board at every instruction set of this
+ * machine: the pattern codes of the legal moves, and the mobility counts, which are also counted on the board
+ */
+class board_fuzzer {
+public:
+	board_fuzzer(unsigned seed = 1) : seed(seed) {}
+
+	/**
+	 * test the given number of games on the workers, and report the first divergence, i.e., the one of
+	 * the smallest game index, which is replayed alone by fuzzing only that game with its seed
+	 * return true if there is no divergence
+	 */
+	bool run(size_t games, pool& workers, std::ostream& out) {
+		std::atomic<size_t> next(0), first(games), tested(0), attempts(0);
+		workers.parallel(workers.size(), [&](size_t) {
+			for (size_t g; (g = next++) < games && g < first; ) {
+				size_t n = 0;
+				bool same = replay(g, n, nullptr);
+				tested++;
+				attempts += n;
+				for (size_t f = first; !same && g < f && !first.compare_exchange_weak(f, g); );
+			}
+		});
+		out << "fuzz: " << tested << " games, " << attempts << " attempts";
+		if (first == games) {
+			out << ", no divergence" << std::endl;
+			return true;
+		}
+		out << std::endl;
+		size_t n = 0;
+		replay(first, n, &out);
+		return false;
+	}
+
+	/**
+	 * replay the move streams of the given number of games on each backend, and show their speeds
+	 */
+	void benchmark(size_t games, std::ostream& out) {
+		std::vector<std::vector<int>> streams(games);
+		for (size_t g = 0; g < games; g++) streams[g] = stream(g);
+		size_t attempts = 0, legal[2] = { 0, 0 };
+		for (const auto& s : streams) attempts += s.size();
+
+		auto t0 = std::chrono::steady_clock::now();
+		for (const auto& s : streams) {
+			board b;
+			for (int a : s) legal[0] += apply(b, a) == board::legal;
+		}
+		auto t1 = std::chrono::steady_clock::now();
+		for (const auto& s : streams) {
+			bitboard b;
+			for (int a : s) legal[1] += apply(b, a) == board::legal;
+		}
+		auto t2 = std::chrono::steady_clock::now();
+		double ref = std::chrono::duration<double>(t1 - t0).count();
+		double cand = std::chrono::duration<double>(t2 - t1).count();
+		out << "benchmark: " << attempts << " attempts of " << games << " games (" << legal[0] << "|" << legal[1] << " legal)" << std::endl;
+		out << "board    " << (attempts / ref) << " attempts/s" << std::endl;
+		out << "bitboard " << (attempts / cand) << " attempts/s (" << (ref / cand) << "x)" << std::endl;
+
+		std::vector<board> positions;
+		for (const auto& s : streams) {
+			board b;
+			for (int a : s)
+				if (apply(b, a) == board::legal) positions.push_back(b);
+		}
+		for (int l = 0; l <= isa::detect(); l++) { // the speed of the kernels at every instruction set
+			isa::level level = isa::level(l);
+			uint16_t codes[board::size_x * board::size_y];
+			size_t moves = 0;
+			auto t3 = std::chrono::steady_clock::now();
+			for (const board& b : positions) moves += pattern_weights::legal_codes(b, codes, level);
+			auto t4 = std::chrono::steady_clock::now();
+			for (const board& b : positions) mobility::count(b, 3, level);
+			auto t5 = std::chrono::steady_clock::now();
+			double patterns = std::chrono::duration<double>(t4 - t3).count();
+			double mobility = std::chrono::duration<double>(t5 - t4).count();
+			out << isa::names(level) << ": " << (positions.size() / patterns) << " pattern scans/s ("
+			    << moves << " legal moves in " << positions.size() << " positions), "
+			    << (positions.size() / mobility) << " mobility counts/s" << std::endl;
+		}
+	}
+
+protected:
+	/**
+	 * get the attempts of a game, where an attempt is a point index, plus 1000 for the wrong color,
+	 * or -1 for a pass
+	 */
+	std::vector<int> stream(size_t g) const {
+		std::default_random_engine engine(seed + g);
+		std::uniform_int_distribution<int> any(0, 99), point(-2, board::size_x * board::size_y);
+		std::vector<int> moves;
+		board b;
+		for (int misses = 0; misses < 64; ) {
+			int r = any(engine), a = point(engine);
+			if (r < 2) a = -1;
+			else if (r < 4 && a >= 0) a += 1000;
+			else if (a < 0) a = board::size_x * board::size_y + a; // out of range of the indexes
+			moves.push_back(a);
+			misses = apply(b, a) == board::legal ? 0 : misses + 1;
+		}
+		return moves;
+	}
+
+	template<typename backend>
+	static board::reward apply(backend& b, int a) {
+		if (a == -1) return b.place(-1, -1);
+		if (a >= 1000) return b.place(board::point(a - 1000), 3u - who_of(b));
+		if (a >= board::size_x * board::size_y) return b.place(board::size_x, a % board::size_y);
+		return b.place(board::point(a));
+	}
+	static std::string describe(int a) {
+		std::stringstream ss;
+		if (a == -1) ss << "pass";
+		else if (a >= 1000) ss << board::point(a - 1000) << " of the wrong color";
+		else if (a >= board::size_x * board::size_y) ss << "out of range (" << board::size_x << ", " << a % board::size_y << ")";
+		else ss << board::point(a);
+		return ss.str();
+	}
+	static unsigned who_of(const board& b) { return b.info().who_take_turns; }
+	static unsigned who_of(const bitboard& b) { return b.who_take_turns(); }
+
+	/**
+	 * replay a game on both backends, count the attempts, and show the divergence if out is given
+	 * return true if they never diverge
+	 */
+	bool replay(size_t g, size_t& n, std::ostream* out) const {
+		board ref;
+		bitboard cand;
+		for (int a : stream(g)) {
+			board before = ref;
+			board::reward r = apply(ref, a), c = apply(cand, a);
+			n++;
+			std::string kernel;
+			if (r == c && cand.matches(ref) && (r != board::legal
+					|| ((kernel = legal_moves(ref, cand)).empty() && (kernel = kernels(ref)).empty()))) continue;
+			if (out) {
+				(*out) << "divergence in game " << g << " at attempt " << n << ": " << describe(a);
+				if (kernel.size()) (*out) << ", " << kernel << std::endl << ref;
+				else (*out) << ", board = " << r << ", bitboard = " << c << std::endl << before;
+				(*out) << "reproduce with --fuzz=1 --fuzz-seed=" << (seed + g) << std::endl;
+			}
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	 * check the legal moves of both sides on the bitboard against board::place(), where the side
+	 * not to move is tested on a copy of the board with the turn given to it
+	 * return the side whose legal moves diverge, or an empty string
+	 */
+	static std::string legal_moves(const board& ref, const bitboard& cand) {
+		for (unsigned who = board::black; who <= board::white; who++)
+			if (cand.legal(who) != legal_of(ref, who)) return who == board::black ? "bitboard legal moves of black" : "bitboard legal moves of white";
+		return std::string();
+	}
+	static bitboard::mask legal_of(const board& ref, unsigned who) {
+		board turn = ref;
+		turn.info({ board::piece_type(who), ref.info().last_move });
+		bitboard::mask legal = 0;
+		for (int i = 0; i < board::size_x * board::size_y; i++) {
+			board after = turn;
+			if (after.place(board::point(i)) == board::legal) legal |= bitboard::bit(i);
+		}
+		return legal;
+	}
+
+	/**
+	 * count the moves of the mobility evaluation by board::place() and a flood of the empty regions
+	 * on the board, as the reference of mobility::count()
+	 */
+	static mobility::moves reference_moves(const board& state, int small_region) {
+		unsigned who = state.info().who_take_turns;
+		bitboard::mask own = legal_of(state, who), opp = legal_of(state, 3u - who);
+		mobility::moves m = { bitboard::count(own), bitboard::count(opp), bitboard::count(own & ~opp), bitboard::count(opp & ~own), 0 };
+		std::vector<bool> seen(board::size_x * board::size_y, false);
+		for (int i = 0; i < board::size_x * board::size_y && m.own; i++) {
+			if (seen[i] || state(i) != board::empty) continue;
+			int size = 0, shared = 0;
+			std::vector<int> flood(1, i);
+			seen[i] = true;
+			while (flood.size()) {
+				board::point p(flood.back());
+				flood.pop_back();
+				size++;
+				shared += bool((own & opp) & bitboard::bit(p.i));
+				const int step[4][2] = { {-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+				for (const auto& d : step) {
+					int x = p.x + d[0], y = p.y + d[1];
+					if (x < 0 || x >= board::size_x || y < 0 || y >= board::size_y) continue;
+					int n = board::point(x, y).i;
+					if (seen[n] || state(n) != board::empty) continue;
+					seen[n] = true;
+					flood.push_back(n);
+				}
+			}
+			m.shared += (shared && size <= small_region) ? 1 : shared;
+		}
+		return m;
+	}
+
+	/**
+	 * check the kernels on a position at every instruction set of this machine
+	 * return the kernel that diverges from the board, or an empty string
+	 */
+	static std::string kernels(const board& state) {
+		unsigned who = state.info().who_take_turns;
+		std::vector<uint16_t> expect;
+		for (int i = 0; i < board::size_x * board::size_y; i++) {
+			board after = state;
+			if (after.place(board::point(i)) == board::legal) expect.push_back(pattern_weights::code(state, i, who));
+		}
+		board fresh(state, state.info()); // with the pattern codes rebuilt from the stones
+		for (int i = 0; i < board::size_x * board::size_y; i++)
+			if (fresh.pattern(i) != state.pattern(i)) return "board pattern codes";
+		mobility::moves base = reference_moves(state, 3);
+		for (int l = 0; l <= isa::detect(); l++) {
+			isa::level level = isa::level(l);
+			uint16_t codes[board::size_x * board::size_y];
+			size_t n = pattern_weights::legal_codes(state, codes, level);
+			if (n != expect.size() || !std::equal(expect.begin(), expect.end(), codes))
+				return std::string("pattern codes at ") + isa::names(level);
+			if (!(mobility::count(state, 3, level) == base))
+				return std::string("mobility counts at ") + isa::names(level);
+		}
+		return std::string();
+	}
+
+private:
+	unsigned seed;
+};
@@ -0,0 +1,512 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * gtp.h: Go Text Protocol front-end of the framework
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+#include "episode.h"
+#include "statistic.h"
+
+/**
+ * GTP shell over a pair of players and the statistic of the games
+ *
+ * commands are tokenized in place without copying the line and dispatched by a static table,
+ * so only the handlers that need a string argument (e.g., a move) make one;
+ * replies are collected in a reused buffer and flushed only at reply boundaries,
+ * while all diagnostics go to std::cerr
+ */
+class gtp {
+public:
+	gtp(statistic& stat, agent& black, agent& white, const std::string& name, const std::string& version)
+		: stat(stat), black(black), white(white), name(name), version(version) {
+		reply.reserve(1024);
+	}
+
+	/**
+	 * a token refers to a part of the command line, which is not null-terminated
+	 */
+	struct token {
+		const char* ptr;
+		size_t len;
+		bool operator ==(const char* s) const { return std::strncmp(ptr, s, len) == 0 && s[len] == '\0'; }
+		operator std::string() const { return std::string(ptr, len); }
+	};
+	enum { max_args = 8 };
+
+	/**
+	 * run the shell until quit or EOF
+	 */
+	void run(FILE* in, FILE* out) {
+		char* line = nullptr;
+		size_t cap = 0;
+		for (ssize_t len; (len = ::getline(&line, &cap, in)) != -1; ) {
+			std::string& res = execute(line, len);
+			if (res.size()) {
+				std::fwrite(res.data(), 1, res.size(), out);
+				std::fflush(out);
+			}
+			if (closed) break;
+		}
+		std::free(line);
+	}
+
+	/**
+	 * execute a command line and get the full reply, which is empty if the line is blank
+	 * the shell is closed after quit or a fatal error, see is_closed()
+	 * an exception of a handler becomes a failure reply, so it never leaves the shell or a server session
+	 */
+	std::string& execute(const char* line, size_t len) {
+		reply.clear();
+		token args[max_args];
+		size_t argc = tokenize(line, len, args);
+		if (argc == 0 || closed) return reply;
+
+		token* cmd = args;
+		token id = { cmd->ptr, 0 };
+		if (std::isdigit((unsigned char) cmd->ptr[0])) { // optional command id
+			id = *cmd;
+			if (--argc == 0) return reply;
+			cmd++;
+		}
+
+		const entry* handler = find(*cmd);
+		size_t head = reply.size();
+		reply += "= ";
+		result res = result::failure;
+		try {
+			if (handler) res = (this->*(handler->exec))(cmd + 1, argc - 1);
+		} catch (...) {
+			reply.resize(head + 2);
+			reply += failure();
+			res = result::failure;
+		}
+		if (res == result::failure) {
+			if (!handler) reply += "unknown command";
+			reply[head] = '?';
+		}
+		if (res == result::pending) { // the reply is completed by resume()
+			pending_id.assign(id.ptr, id.len);
+			return idle;
+		}
+		if (id.len) reply.insert(head + 1, id.ptr, id.len);
+		if (res == result::abort) {
+			reply.clear(); // terminate without reply
+		} else {
+			reply += "\n\n";
+		}
+		if (res == result::fatal || res == result::abort) closed = true;
+		return reply;
+	}
+
+	bool is_closed() const { return closed; }
+
+	/**
+	 * let nogo-analyze search in slices of the given number of cycles, so that a command
+	 * may stay pending after execute() until resume() finishes it (0 for no slices)
+	 */
+	void slice(size_t cycles) { slice_cycles = cycles; }
+
+	/**
+	 * allow or forbid save_tree and load_tree, which read and write any path given by the client,
+	 * e.g., they are forbidden in the sessions of the TCP server
+	 */
+	void allow_files(bool allow) { files = allow; }
+
+	bool is_pending() const { return pending; }
+
+	/**
+	 * run another slice of the pending command, and get its full reply once it is finished,
+	 * or an empty reply while it is still pending
+	 */
+	std::string& resume() {
+		if (!pending) return idle;
+		try {
+			if (!analyst->resume_ponder(slice_cycles)) return idle;
+			reply += analyst->analysis("visits");
+		} catch (...) {
+			reply.assign("? ");
+			reply += failure();
+		}
+		pending = false;
+		if (pending_id.size()) reply.insert(1, pending_id);
+		pending_id.clear();
+		reply += "\n\n";
+		return reply;
+	}
+
+	/**
+	 * close the ongoing episode if there is one
+	 */
+	void close() {
+		if (stat.is_episode_ongoing()) {
+			agent& win = stat.back().last_turns(black, white);
+			stat.close_episode(win.name());
+			black.close_episode(win.name());
+			white.close_episode(win.name());
+		}
+	}
+
+protected:
+	enum class result { success, failure, fatal, abort, pending };
+	typedef result (gtp::*handler)(const token* args, size_t argc);
+	struct entry {
+		const char* name;
+		handler exec;
+	};
+
+	static size_t tokenize(const char* line, size_t len, token* args) {
+		size_t argc = 0;
+		for (size_t i = 0; i < len && argc < max_args; ) {
+			while (i < len && std::isspace((unsigned char) line[i])) i++;
+			size_t j = i;
+			while (j < len && !std::isspace((unsigned char) line[j])) j++;
+			if (j > i) args[argc++] = { line + i, j - i };
+			i = j;
+		}
+		return argc;
+	}
+
+	/**
+	 * get the reply of the exception being handled, and show it on std::cerr
+	 */
+	static std::string failure() {
+		try {
+			throw;
+		} catch (std::logic_error& e) { // e.g., std::invalid_argument and std::out_of_range of a conversion
+			std::cerr << "invalid argument: " << e.what() << std::endl;
+			return "invalid argument";
+		} catch (std::exception& e) {
+			std::cerr << "command failed: " << e.what() << std::endl;
+			return e.what();
+		} catch (...) {
+			std::cerr << "command failed" << std::endl;
+			return "command failed";
+		}
+	}
+
+	/**
+	 * parse a decimal argument without exceptions, return false if it is not a number
+	 */
+	static bool number(const token& arg, size_t& value) {
+		char buf[24];
+		if (arg.len >= sizeof(buf) || !std::isdigit((unsigned char) arg.ptr[0])) return false;
+		std::memcpy(buf, arg.ptr, arg.len);
+		buf[arg.len] = '\0';
+		char* end;
+		errno = 0;
+		unsigned long long n = std::strtoull(buf, &end, 10);
+		if (*end != '\0' || errno == ERANGE) return false;
+		value = n;
+		return true;
+	}
+
+	static const entry* find(const token& cmd) {
+		static const entry table[] = {
+			{ "play", &gtp::cmd_play },
+			{ "genmove", &gtp::cmd_genmove },
+			{ "clear_board", &gtp::cmd_clear_board },
+			{ "showboard", &gtp::cmd_showboard },
+			{ "boardsize", &gtp::cmd_boardsize },
+			{ "name", &gtp::cmd_name },
+			{ "version", &gtp::cmd_version },
+			{ "protocol_version", &gtp::cmd_protocol_version },
+			{ "list_commands", &gtp::cmd_list_commands },
+			{ "save_tree", &gtp::cmd_save_tree },
+			{ "load_tree", &gtp::cmd_load_tree },
+			{ "gogui-analyze_commands", &gtp::cmd_analyze_commands },
+			{ "nogo-analyze", &gtp::cmd_analyze },
+			{ "nogo-visits", &gtp::cmd_visits },
+			{ "nogo-winrates", &gtp::cmd_winrates },
+			{ "nogo-pv", &gtp::cmd_pv },
+			{ "quit", &gtp::cmd_quit },
+		};
+		for (const entry& e : table)
+			if (cmd == e.name) return &e;
+		return nullptr;
+	}
+
+	/**
+	 * play a move
+	 */
+	result cmd_play(const token* args, size_t argc) {
+		return play(args, argc, false);
+	}
+
+	/**
+	 * generate a move and play
+	 */
+	result cmd_genmove(const token* args, size_t argc) {
+		return play(args, argc, true);
+	}
+
+	/**
+	 * play a move, or generate a move and play
+	 */
+	result play(const token* args, size_t argc, bool genmove) {
+		if (argc < (genmove ? 1u : 2u)) {
+			reply += "syntax error";
+			return result::failure;
+		}
+		if (!stat.is_episode_ongoing()) { // should open an episode
+			black.open_episode("~:" + white.name());
+			white.open_episode(black.name() + ":~");
+			stat.open_episode(black.name() + ":" + white.name());
+		}
+
+		episode& game = stat.back();
+		agent& who = game.take_turns(black, white);
+		if (who.role()[0] != std::tolower(args[0].ptr[0])) { // player mismatch?!
+			reply += "resign";
+			// show the error message and terminate the shell
+			std::cerr << "player color " << std::string(args[0]) << " mismatch!" << std::endl;
+			std::cerr << "current state, "
+			          << who.role() << " to play: " << std::endl << game.state();
+			return result::fatal;
+		}
+		if (!genmove) { // play a move
+			std::string types = "?bw"; // black == 1, white == 2
+			action::place move(board::point(std::string(args[1])), types.find(who.role()[0]));
+			if (game.apply_action(move) != true) { // remote plays an illegal move?!
+				reply += "resign";
+				// show the error message and terminate the shell
+				std::cerr << who.role() << " plays an illegal action!" << std::endl;
+				const char* reason[] = {
+					"legal",
+					"illegal_turn",
+					"illegal_pass",
+					"illegal_out_of_range",
+					"illegal_not_empty",
+					"illegal_suicide",
+					"illegal_take",
+					"unknown",
+				};
+				std::cerr << "current state: " << std::endl << game.state();
+				int code = move.apply(game.state());
+				std::cerr << "action: " << std::string(args[0]) << " " << std::string(args[1]) << std::endl;
+				std::cerr << "reason: " << reason[std::min(-code, 7)] << std::endl;
+				return result::fatal;
+			}
+		} else { // generate a move and play
+			analyst = &who;
+			action::place move = who.take_action(game.state());
+			if (game.apply_action(move) == true) {
+				reply += std::string(move.position());
+			} else { // I have no legal move to play
+				reply += "resign";
+			}
+		}
+		return result::success;
+	}
+
+	/**
+	 * reset the game
+	 */
+	result cmd_clear_board(const token* args, size_t argc) {
+		close();
+		return result::success;
+	}
+
+	/**
+	 * print the board
+	 */
+	result cmd_showboard(const token* args, size_t argc) {
+		std::stringstream buf;
+		buf << (stat.is_episode_ongoing() ? stat.back().state() : board());
+		reply += "\n" + buf.str();
+		reply.pop_back(); // remove a new line
+		return result::success;
+	}
+
+	/**
+	 * set the board size
+	 */
+	result cmd_boardsize(const token* args, size_t argc) {
+		if (argc < 1) {
+			reply += "syntax error";
+			return result::failure;
+		}
+		size_t size;
+		if (!number(args[0], size)) {
+			reply += "invalid argument";
+			return result::failure;
+		}
+		if (size != board::size_x || size != board::size_y) {
+			std::cerr << "board size mismatch: " << std::string(args[0]) << std::endl;
+		}
+		if (size > board::size_x || size > board::size_y) return result::abort;
+		return result::success;
+	}
+
+	/**
+	 * report the name of the program
+	 */
+	result cmd_name(const token* args, size_t argc) {
+		reply += name;
+		return result::success;
+	}
+
+	/**
+	 * report the version number of the program
+	 */
+	result cmd_version(const token* args, size_t argc) {
+		reply += version;
+		return result::success;
+	}
+
+	/**
+	 * report GTP protocol version
+	 */
+	result cmd_protocol_version(const token* args, size_t argc) {
+		reply += "2";
+		return result::success;
+	}
+
+	/**
+	 * print supported commands
+	 */
+	result cmd_list_commands(const token* args, size_t argc) {
+		reply += "play\n" "genmove\n" "clear_board\n" "showboard\n" "boardsize\n"
+		         "name\n" "version\n" "protocol_version\n" "list_commands\n";
+		if (files) reply += "save_tree\n" "load_tree\n";
+		reply += "gogui-analyze_commands\n" "nogo-analyze\n" "nogo-visits\n" "nogo-winrates\n" "nogo-pv\n" "quit";
+		return result::success;
+	}
+
+	/**
+	 * save the search tree of a player, e.g., "save_tree b black.tree"
+	 */
+	result cmd_save_tree(const token* args, size_t argc) {
+		if (!files) {
+			reply += "unknown command";
+			return result::failure;
+		}
+		agent* who = argc >= 2 ? color(args[0]) : nullptr;
+		if (!who || !who->save_tree(args[1])) {
+			reply += "cannot save tree";
+			return result::failure;
+		}
+		return result::success;
+	}
+
+	/**
+	 * load the search tree of a player, which continues searching once its position is reached
+	 */
+	result cmd_load_tree(const token* args, size_t argc) {
+		if (!files) {
+			reply += "unknown command";
+			return result::failure;
+		}
+		agent* who = argc >= 2 ? color(args[0]) : nullptr;
+		if (!who || !who->load_tree(args[1])) {
+			reply += "cannot load tree";
+			return result::failure;
+		}
+		return result::success;
+	}
+
+	/**
+	 * list the GoGui analysis commands
+	 */
+	result cmd_analyze_commands(const token* args, size_t argc) {
+		reply += "gfx/Analyze/nogo-analyze\n"
+		         "gfx/Visits/nogo-visits\n"
+		         "gfx/Win Rates/nogo-winrates\n"
+		         "var/Principal Variation/nogo-pv";
+		return result::success;
+	}
+
+	/**
+	 * search the current position for the side to move without playing, e.g., "nogo-analyze 10000",
+	 * and show the visits; with live=MS in the player arguments the visits are also streamed meanwhile
+	 */
+	result cmd_analyze(const token* args, size_t argc) {
+		const board& state = stat.is_episode_ongoing() ? stat.back().state() : board();
+		analyst = (state.info().who_take_turns == board::black) ? &black : &white;
+		size_t N = 1000;
+		if (argc && !number(args[0], N)) {
+			reply += "invalid N";
+			return result::failure;
+		}
+		if (slice_cycles) {
+			analyst->start_ponder(state, N);
+			pending = true;
+			return result::pending;
+		}
+		analyst->ponder(state, N);
+		return cmd_visits(args, argc);
+	}
+
+	/**
+	 * show the visit counts of the last search
+	 */
+	result cmd_visits(const token* args, size_t argc) {
+		if (analyst) reply += analyst->analysis("visits");
+		return result::success;
+	}
+
+	/**
+	 * show the win rates of the last search
+	 */
+	result cmd_winrates(const token* args, size_t argc) {
+		if (analyst) reply += analyst->analysis("winrates");
+		return result::success;
+	}
+
+	/**
+	 * show the principal variation of the last search
+	 */
+	result cmd_pv(const token* args, size_t argc) {
+		if (analyst) reply += analyst->analysis("pv");
+		return result::success;
+	}
+
+	/**
+	 * get the player of a color argument, or null if it is not a color
+	 */
+	agent* color(const token& arg) {
+		char c = std::tolower(arg.ptr[0]);
+		if (c == black.role()[0]) return &black;
+		if (c == white.role()[0]) return &white;
+		return nullptr;
+	}
+
+	/**
+	 * close the game and quit
+	 */
+	result cmd_quit(const token* args, size_t argc) {
+		close();
+		closed = true;
+		return result::success;
+	}
+
+private:
+	statistic& stat;
+	agent& black;
+	agent& white;
+	std::string name;
+	std::string version;
+	std::string reply;
+	bool closed = false;
+	bool files = true; // save_tree and load_tree are allowed
+	agent* analyst = nullptr; // the player of the last search
+	size_t slice_cycles = 0;
+	bool pending = false; // nogo-analyze is searching in slices
+	std::string pending_id; // of the pending command
+	std::string idle; // the empty reply of a pending command
+};
@@ -0,0 +1,72 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * isa.h: Instruction set levels of the kernels built in several variants
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+
+/**
+ * a kernel of several variants is written once as an always-inline body, and every variant is
+ * a wrapper of that body compiled for its own instruction set by a target attribute, so that the
+ * program is built for the baseline ISA and still uses the newer instructions where they exist
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ISA_X86 1
+#define ISA_INLINE inline __attribute__((always_inline))
+#define ISA_SSE42 __attribute__((target("sse4.2,popcnt")))
+#define ISA_AVX2 __attribute__((target("avx2,bmi,bmi2,lzcnt,popcnt")))
+#else
+#define ISA_X86 0
+#define ISA_INLINE inline
+#define ISA_SSE42
+#define ISA_AVX2
+#endif
+
+/**
+ * the instruction set levels, where each level includes those below it
+ * the level in use is detected by CPUID at the first call of selected(), and may be lowered by select()
+ */
+class isa {
+public:
+	enum level { baseline = 0, sse42 = 1, avx2 = 2, levels = 3 };
+
+	static level detect() {
+#if ISA_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("popcnt")) return avx2;
+		if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt")) return sse42;
+#endif
+		return baseline;
+	}
+
+	static level selected() { return current(); }
+
+	/**
+	 * use the named level, or the detected level if it is lower, e.g., to compare the variants
+	 * return false if the name is unknown
+	 */
+	static bool select(const std::string& name) {
+		for (int i = 0; i < levels; i++) {
+			if (name != names(level(i))) continue;
+			current() = std::min(level(i), detect());
+			return true;
+		}
+		return false;
+	}
+
+	static const char* names(level l) {
+		static const char* name[] = { "baseline", "sse4.2", "avx2" };
+		return name[l];
+	}
+
+private:
+	static level& current() {
+		static level l = detect();
+		return l;
+	}
+};
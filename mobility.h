@@ -0,0 +1,101 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * mobility.h: Static evaluation of positions by the mobility of both sides
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <cmath>
+#include "board.h"
+#include "bitboard.h"
+#include "isa.h"
+
+/**
+ * playout-free evaluation of a position, as the probability that the side to move wins
+ *
+ * a NoGo game is lost by the side who runs out of legal moves first, so the evaluation counts
+ * the safe points of each side, i.e., those that only this side can play, and the shared points,
+ * which are taken alternately; a small empty region (at most small_region points) is counted as
+ * a single shared move, since the first stone in it usually makes the rest illegal for both sides
+ *
+ * with equal safe points, the side to move wins only if the number of shared moves is odd,
+ * so the margin is (own safe - opponent safe) +- 0.5 by the parity, plus mobility times the
+ * difference of all legal moves, and it is squashed into a probability by a logistic of the given scale
+ *
+ * the moves are counted by the variant of the selected instruction set (see isa.h), while the margin
+ * is computed by the same code for all variants, so the evaluation never depends on the machine
+ */
+class mobility {
+public:
+	mobility(float scale = 0.5f, float weight = 0.05f, int small_region = 3)
+		: scale(scale), weight(weight), small_region(small_region) {}
+
+public:
+	/**
+	 * get the probability that the side to move wins, which is 0 if it has no legal move
+	 */
+	float evaluate(const board& state) const {
+		moves m = count(state, small_region);
+		if (!m.own) return 0;
+		float margin = m.safe_own - m.safe_opp + (m.shared % 2 ? 0.5f : -0.5f);
+		margin += weight * (m.own - m.opp);
+		return 1 / (1 + std::exp(-scale * margin));
+	}
+
+	/**
+	 * get the probability that black wins
+	 */
+	float black_wins(const board& state) const {
+		float p = evaluate(state);
+		return state.info().who_take_turns == board::black ? p : 1 - p;
+	}
+
+	/**
+	 * the legal moves of both sides, the safe moves of both sides, and the shared moves,
+	 * where a small region counts as a single shared move
+	 */
+	struct moves {
+		int own, opp;
+		int safe_own, safe_opp;
+		int shared;
+		bool operator ==(const moves& m) const {
+			return own == m.own && opp == m.opp && safe_own == m.safe_own && safe_opp == m.safe_opp && shared == m.shared;
+		}
+	};
+
+	/**
+	 * count the moves of the side to move and its opponent by the variant of the given instruction set
+	 */
+	static moves count(const board& state, int small_region, isa::level level = isa::selected()) {
+		static moves (* const variant[isa::levels])(const board&, int) = {
+			count_baseline, count_sse42, count_avx2 };
+		return variant[level](state, small_region);
+	}
+
+protected:
+	ISA_INLINE static moves count_moves(const board& state, int small_region) {
+		bitboard b(state);
+		unsigned who = b.who_take_turns();
+		bitboard::mask own = b.legal(who), opp = b.legal(3u - who);
+		bitboard::mask shared = own & opp;
+		moves m = { bitboard::count(own), bitboard::count(opp), bitboard::count(own & ~opp), bitboard::count(opp & ~own), 0 };
+		for (bitboard::mask left = b.empties(); left && m.own; ) {
+			bitboard::mask region = bitboard::block(left & -left, left);
+			int n = bitboard::count(region & shared);
+			m.shared += (n && bitboard::count(region) <= small_region) ? 1 : n;
+			left &= ~region;
+		}
+		return m;
+	}
+	static moves count_baseline(const board& state, int small_region) { return count_moves(state, small_region); }
+	ISA_SSE42 static moves count_sse42(const board& state, int small_region) { return count_moves(state, small_region); }
+	ISA_AVX2 static moves count_avx2(const board& state, int small_region) { return count_moves(state, small_region); }
+
+private:
+	float scale;
+	float weight;
+	int small_region;
+};
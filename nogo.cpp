@@ -11,22 +11,46 @@
 #include <fstream>
 #include <iterator>
 #include <string>
+#include <map>
 #include "board.h"
 #include "action.h"
 #include "agent.h"
 #include "episode.h"
 #include "statistic.h"
+#include "gtp.h"
+#include "server.h"
+#include "archive.h"
+#include "book.h"
+#include "pattern.h"
+#include "tuner.h"
+#include "selfplay.h"
+#include "fuzzer.h"
+#include "isa.h"
 
 int main(int argc, const char* argv[]) {
-	std::cout << "HollowNoGo-Demo: ";
-	std::copy(argv, argv + argc, std::ostream_iterator<const char*>(std::cout, " "));
-	std::cout << std::endl << std::endl;
-
 	size_t total = 20, block = 0, limit = 0;
 	std::string black_args, white_args;
 	std::string load, save;
+	std::string verify; // archive to replay and verify
+	std::string index, book, query; // archives to build the book from, the book, and moves to look up in it
+	size_t book_min = 2; // the fewest games of a position kept in the book
+	std::string train, patterns; // archives to train the pattern weights from, and the weight file
+	size_t iterations = 20; // of the pattern trainer or the tuner
+	std::string tune, checkpoint; // parameters to tune for the black arguments, and the file to resume from
+	size_t games = 0; // per tuning iteration, twice the threads by default
+	std::string coordinate, work; // [HOST:]PORT to coordinate the workers, and HOST:PORT of the coordinator
+	size_t batch = 4; // games per batch of the coordinator
+	double worker_timeout = 600; // seconds of silence before the coordinator gives up a worker holding batches
 	std::string name = "TCG-HollowNoGo-Demo", version = "2021"; // for GTP shell
-	bool summary = false, shell = false;
+	unsigned serve = 0; // port for the GTP server
+	size_t slice = 256; // cycles of an analysis per task of the GTP server, 0 for no slices
+	size_t threads = 1; // size of the shared thread pool, 0 for all cores
+	double timeout = 0; // per-move time limit in milliseconds, for the latency report
+	bool summary = false, shell = false, pin = false;
+	bool deterministic = false; // replay the local games identically at any number of threads
+	size_t fuzz = 0; // games to test the bitboard against the board
+	unsigned fuzz_seed = 1; // seed of the first fuzzing game
+	std::string instructions; // instruction set of the kernels, the best one of this machine by default
 	for (int i = 1; i < argc; i++) {
 		std::string para(argv[i]);
 		if (para.find("--total=") == 0) {
@@ -43,6 +67,36 @@ int main(int argc, const char* argv[]) {
 			load = para.substr(para.find("=") + 1);
 		} else if (para.find("--save=") == 0) {
 			save = para.substr(para.find("=") + 1);
+		} else if (para.find("--verify=") == 0) {
+			verify = para.substr(para.find("=") + 1);
+		} else if (para.find("--index=") == 0) {
+			index = para.substr(para.find("=") + 1);
+		} else if (para.find("--book=") == 0) {
+			book = para.substr(para.find("=") + 1);
+		} else if (para.find("--book-min=") == 0) {
+			book_min = std::stoull(para.substr(para.find("=") + 1));
+		} else if (para.find("--train=") == 0) {
+			train = para.substr(para.find("=") + 1);
+		} else if (para.find("--patterns=") == 0) {
+			patterns = para.substr(para.find("=") + 1);
+		} else if (para.find("--iterations=") == 0) {
+			iterations = std::stoull(para.substr(para.find("=") + 1));
+		} else if (para.find("--tune=") == 0) {
+			tune = para.substr(para.find("=") + 1);
+		} else if (para.find("--games=") == 0) {
+			games = std::stoull(para.substr(para.find("=") + 1));
+		} else if (para.find("--checkpoint=") == 0) {
+			checkpoint = para.substr(para.find("=") + 1);
+		} else if (para.find("--coordinator=") == 0) {
+			coordinate = para.substr(para.find("=") + 1);
+		} else if (para.find("--worker=") == 0) {
+			work = para.substr(para.find("=") + 1);
+		} else if (para.find("--batch=") == 0) {
+			batch = std::stoull(para.substr(para.find("=") + 1));
+		} else if (para.find("--worker-timeout=") == 0) {
+			worker_timeout = std::stod(para.substr(para.find("=") + 1));
+		} else if (para.find("--query=") == 0) {
+			query = para.substr(para.find("=") + 1);
 		} else if (para.find("--name=") == 0) {
 			name = para.substr(para.find("=") + 1);
 		} else if (para.find("--version=") == 0) {
@@ -51,11 +105,144 @@ int main(int argc, const char* argv[]) {
 			summary = true;
 		} else if (para.find("--shell") == 0) {
 			shell = true;
+		} else if (para.find("--serve=") == 0) {
+			serve = std::stoul(para.substr(para.find("=") + 1));
+		} else if (para.find("--slice=") == 0) {
+			slice = std::stoull(para.substr(para.find("=") + 1));
+		} else if (para.find("--threads=") == 0) {
+			threads = std::stoull(para.substr(para.find("=") + 1));
+		} else if (para.find("--timeout=") == 0) {
+			timeout = std::stod(para.substr(para.find("=") + 1));
+		} else if (para.find("--pin") == 0) {
+			pin = true;
+		} else if (para.find("--deterministic") == 0) {
+			deterministic = true;
+		} else if (para.find("--fuzz=") == 0) {
+			fuzz = std::stoull(para.substr(para.find("=") + 1));
+		} else if (para.find("--fuzz-seed=") == 0) {
+			fuzz_seed = std::stoul(para.substr(para.find("=") + 1));
+		} else if (para.find("--isa=") == 0) {
+			instructions = para.substr(para.find("=") + 1);
 		}
 	}
-	
+
+	std::ostream& banner = (shell || serve) ? std::cerr : std::cout; // stdout is reserved for the GTP shell
+	banner << "HollowNoGo-Demo: ";
+	std::copy(argv, argv + argc, std::ostream_iterator<const char*>(banner, " "));
+	banner << std::endl << std::endl;
+
+	if (instructions.size() && !isa::select(instructions)) {
+		std::cerr << "unknown instruction set: " << instructions << std::endl;
+		return 1;
+	}
+
+	if (deterministic) { // the players do not read the cache, see player::run_parallel()
+		black_args += " deterministic=1";
+		white_args += " deterministic=1";
+	}
+
+	pool::configure(threads, pin);
 	statistic stat(total, block, limit);
 
+	if (verify.size()) { // replay a saved archive in parallel and verify every episode
+		archive games(verify);
+		if (!games.is_open()) {
+			std::cerr << "cannot open archive: " << verify << std::endl;
+			return 1;
+		}
+		auto start = std::chrono::steady_clock::now();
+		archive::summary sum = games.verify(pool::shared());
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		archive::report(std::cout, sum);
+		std::cout << "verified in " << elapsed.count() << " s" << std::endl;
+		return sum.valid() == sum.games ? 0 : 1;
+	}
+
+	if (fuzz) { // test the bitboard and its kernels against the board on random move streams, then compare their speeds
+		board_fuzzer tester(fuzz_seed);
+		if (!tester.run(fuzz, pool::shared(), std::cout)) return 1;
+		tester.benchmark(std::min<size_t>(fuzz, 10000), std::cout);
+		return 0;
+	}
+
+	auto split = [](const std::string& list) { // comma-separated archives
+		std::vector<std::string> archives;
+		for (size_t i = 0, j; i <= list.size(); i = j + 1) {
+			j = std::min(list.find(',', i), list.size());
+			if (j > i) archives.push_back(list.substr(i, j - i));
+		}
+		return archives;
+	};
+
+	if (index.size() && book.size()) { // build a position book from the archives
+		try {
+			size_t n = position_book::build(split(index), book, pool::shared(), book_min);
+			std::cout << "indexed " << n << " positions into " << book << std::endl;
+		} catch (std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	if (train.size() && patterns.size()) { // train the pattern weights from the archives
+		try {
+			pattern_weights weights = pattern_weights::train(split(train), pool::shared(), iterations, std::cout);
+			if (!weights.save(patterns)) throw std::runtime_error("cannot write patterns: " + patterns);
+		} catch (std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	if (tune.size()) { // tune the numeric arguments of the black player by self-play matches
+		try {
+			pool& workers = pool::shared();
+			tuner spsa(tune, black_args, games ? games : 2 * workers.size(), workers);
+			spsa.run(iterations, checkpoint);
+			std::cout << "tuned: " << spsa.args() << std::endl;
+		} catch (std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	if (work.size()) { // play the batches of a coordinator
+		std::string host = work.substr(0, work.rfind(':'));
+		return worker(host, std::stoul(work.substr(work.rfind(':') + 1)), pool::shared()).run();
+	}
+
+	if (book.size()) { // look up the position after the queried moves, e.g., --query="E5 C3"
+		try {
+			position_book positions(book);
+			board state;
+			std::stringstream moves(query);
+			for (std::string move; moves >> move; ) {
+				if (state.place(board::point(move)) != board::legal) {
+					std::cerr << "illegal move in query: " << move << std::endl;
+					return 1;
+				}
+			}
+			position_book::entry info;
+			std::cout << positions.size() << " positions in " << book << std::endl << state;
+			if (!positions.find(state, info)) {
+				std::cout << "position not found" << std::endl;
+				return 0;
+			}
+			std::cout << "games = " << info.games << ", win = " << (info.black_wins * 100.0 / info.games) << "%|"
+			          << ((info.games - info.black_wins) * 100.0 / info.games) << "%" << std::endl;
+			for (const position_book::continuation& next : info.next)
+				std::cout << std::string(board::point(next.move)) << "\tgames = " << next.games
+				          << ", win = " << (next.wins * 100.0 / next.games) << "%" << std::endl;
+		} catch (std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
 	if (load.size()) {
 		std::ifstream in(load, std::ios::in);
 		in >> stat;
@@ -63,128 +250,96 @@ int main(int argc, const char* argv[]) {
 		summary |= stat.is_finished();
 	}
 
-	player black("name=black " + black_args + "N=7000 role=black");
-	player white("name=white " + white_args + "N=7000 role=white");
-
-	if (!shell) { // launch standard local games
-		while (!stat.is_finished()) {
-			black.open_episode("~:" + white.name());
-			white.open_episode(black.name() + ":~");
+	player black("name=black N=7000 " + black_args + " role=black");
+	player white("name=white N=7000 " + white_args + " role=white");
 
-			stat.open_episode(black.name() + ":" + white.name());
-			episode& game = stat.back();
-			while (true) {
-				agent& who = game.take_turns(black, white);
-				action move = who.take_action(game.state());
-				if (game.apply_action(move) != true) break;
-				if (who.check_for_win(game.state())) break;
-			}
-			agent& win = game.last_turns(black, white);
-			stat.close_episode(win.name());
+	if (serve) { // launch GTP server, one session per connection
+		return server(serve, black_args, white_args, name, version, pool::shared(), slice).run();
+	}
 
-			black.close_episode(win.name());
-			white.close_episode(win.name());
+	if (coordinate.size()) { // let the workers play the games, which are recorded here
+		std::string host = coordinate.find(':') != std::string::npos ? coordinate.substr(0, coordinate.rfind(':')) : "127.0.0.1";
+		unsigned port = std::stoul(coordinate.substr(coordinate.rfind(':') + 1));
+		int code = coordinator(port, host == "127.0.0.1" || host == "localhost", stat, black_args, white_args, batch, worker_timeout).run();
+		if (code) return code;
+	} else if (!shell) { // launch standard local games, each thread of the pool plays with its own pair of players
+		pool& workers = pool::shared();
+		size_t games = stat.remaining();
+		std::vector<std::unique_ptr<player>> others; // players of the other threads, seeded differently
+		auto seed_of = [](const player& who) {
+			unsigned seed = 1; // the default seed of std::default_random_engine
+			try { seed = std::stoul(who.property("seed")); } catch (std::out_of_range&) {}
+			return seed;
+		};
+		auto reseed = [&](const player& who, size_t k) { return " seed=" + std::to_string(seed_of(who) + k); };
+		for (size_t k = 1; k < std::min(workers.size(), games); k++) {
+			others.emplace_back(new player("name=black N=7000 " + black_args + reseed(black, k) + " role=black"));
+			others.emplace_back(new player("name=white N=7000 " + white_args + reseed(white, k) + " role=white"));
 		}
-	} else { // launch GTP shell
-		for (std::string command; std::getline(std::cin, command); ) {
-			if (command.back() == '\r') command.pop_back();
-			if (command.empty()) continue;
-
-			std::vector<std::string> args;
-			std::istringstream iss(command);
-			for (std::string s; getline(iss, s, ' '); args.push_back(s));
-
-			std::string reply;
-			if (args[0] == "play" || args[0] == "genmove") { // play a move, or generate a move and play
-				if (!stat.is_episode_ongoing()) { // should open an episode
-					black.open_episode("~:" + white.name());
-					white.open_episode(black.name() + ":~");
-					stat.open_episode(black.name() + ":" + white.name());
-				}
 
-				episode& game = stat.back();
-				agent& who = game.take_turns(black, white);
-				if (who.role()[0] != std::tolower(args[1][0])) { // player mismatch?!
-					std::cout << "= " << "resign" << std::endl << std::endl;
-					// show the error message and terminate the shell
-					std::cerr << "player color " << args[1] << " mismatch!" << std::endl;
-					std::cerr << "current state, "
-					          << who.role() << " to play: " << std::endl << game.state();
-					break;
+		// in deterministic mode, game g is played with seed + g whichever thread takes it,
+		// and the games are recorded in their order
+		std::mutex mtx;
+		size_t next = 0, recorded = 0;
+		std::map<size_t, episode> finished;
+		unsigned black_seed = seed_of(black), white_seed = seed_of(white);
+		auto play = [&](player& black, player& white) {
+			while (true) {
+				size_t g;
+				{
+					std::lock_guard<std::mutex> lock(mtx);
+					if (games == 0) return;
+					games--;
+					g = next++;
 				}
-				if (args[0] == "play") { // play a move
-					std::string types = "?bw"; // black == 1, white == 2
-					action::place move(args[2], types.find(who.role()[0]));
-					if (game.apply_action(move) != true) { // remote plays an illegal move?!
-						std::cout << "= " << "resign" << std::endl << std::endl;
-						// show the error message and terminate the shell
-						std::cerr << who.role() << " plays an illegal action!" << std::endl;
-						const char* reason[] = {
-							"legal",
-							"illegal_turn",
-							"illegal_pass",
-							"illegal_out_of_range",
-							"illegal_not_empty",
-							"illegal_suicide",
-							"illegal_take",
-							"unknown",
-						};
-						std::cerr << "current state: " << std::endl << game.state();
-						int code = move.apply(game.state());
-						std::cerr << "action: " << args[1] << " " << args[2] << std::endl;
-						std::cerr << "reason: " << reason[std::min(-code, 7)] << std::endl;
-						break;
-					}
-				} else if (args[0] == "genmove") { // generate a move and play
-					action::place move = who.take_action(game.state());
-					if (game.apply_action(move) == true) {
-						reply = move.position();
-					} else { // I have no legal move to play
-						reply = "resign";
-					}
+				if (deterministic) {
+					black.reseed(black_seed + g);
+					white.reseed(white_seed + g);
 				}
+				black.open_episode("~:" + white.name());
+				white.open_episode(black.name() + ":~");
 
-			} else if (args[0] == "clear_board" || args[0] == "quit") { // reset game, or quit
-				if (stat.is_episode_ongoing()) { // should close an opened episode
-					agent& win = stat.back().last_turns(black, white);
-					stat.close_episode(win.name());
-					black.close_episode(win.name());
-					white.close_episode(win.name());
+				episode game;
+				game.open_episode(black.name() + ":" + white.name());
+				while (true) {
+					agent& who = game.take_turns(black, white);
+					action move = who.take_action(game.state());
+					if (game.apply_action(move) != true) break;
+					if (who.check_for_win(game.state())) break;
 				}
-				if (args[0] == "quit") break; // quit GTP shell
-
-			} else if (args[0] == "showboard") { // print the board
-				std::stringstream buf;
-				buf << (stat.is_episode_ongoing() ? stat.back().state() : board());
-				reply = "\n" + buf.str();
-				reply.pop_back(); // remove a new line
-
-			} else if (args[0] == "boardsize") { // set the board size
-				size_t size = std::stoul(args[1]);
-				if (size != board::size_x || size != board::size_y) {
-					std::cerr << "board size mismatch: " << args[1] << std::endl;
+				agent& win = game.last_turns(black, white);
+				game.close_episode(win.name());
+
+				black.close_episode(win.name());
+				white.close_episode(win.name());
+
+				std::lock_guard<std::mutex> lock(mtx);
+				if (!deterministic) {
+					stat.append(game);
+					continue;
 				}
-				if (size > board::size_x || size > board::size_y) break;
-
-			} else if (args[0] == "name") { // report the name of the program
-				reply = name;
-			} else if (args[0] == "version") { // report the version number of the program
-				reply = version;
-			} else if (args[0] == "protocol_version") { // report GTP protocol version
-				reply = "2";
-			} else if (args[0] == "list_commands") { // print supported commands
-				reply = "play\n" "genmove\n" "clear_board\n" "showboard\n" "boardsize\n"
-				        "name\n" "version\n" "protocol_version\n" "list_commands\n" "quit\n";
-			} else {
-				reply = "unknown command";
+				finished[g] = game;
+				for (auto it = finished.begin(); it != finished.end() && it->first == recorded; it = finished.erase(it), recorded++)
+					stat.append(it->second);
 			}
-
-			std::cout << "= " << reply << std::endl << std::endl;
+		};
+		workers.parallel(others.size() / 2 + 1, [&](size_t k) {
+			if (k == 0) play(black, white);
+			else play(*others[k * 2 - 2], *others[k * 2 - 1]);
+		});
+		for (size_t k = 0; k < others.size(); k += 2) {
+			black.absorb_claims(*others[k]);
+			white.absorb_claims(*others[k + 1]);
 		}
+	} else { // launch GTP shell
+		stat.redirect(std::cerr);
+		gtp(stat, black, white, name, version).run(stdin, stdout);
 	}
 
 	if (summary) {
-		stat.summary();
+		stat.summary(timeout);
+		banner << black.claim_summary() << std::endl; // stdout is reserved for the GTP shell
+		banner << white.claim_summary() << std::endl;
 	}
 
 	if (save.size()) {
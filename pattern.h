@@ -0,0 +1,342 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * pattern.h: 3x3 pattern weights for playouts, and their offline trainer
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <array>
+#include <random>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include "board.h"
+#include "bitboard.h"
+#include "archive.h"
+#include "pool.h"
+#include "isa.h"
+#if ISA_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * weights of the 3x3 patterns around a move, i.e., the strengths (gamma) of the Bradley-Terry model
+ *
+ * a pattern code packs the 8 neighbors of a point with 2 bits each, as empty, own stone, opponent
+ * stone, or off-board (including hollow points), so the same shape has the same code for both sides;
+ * the 8 symmetries of a shape share the weight of their smallest code
+ */
+class pattern_weights {
+public:
+	enum { codes = 1 << 16 };
+	enum neighbor { empty = 0u, own = 1u, opp = 2u, edge = 3u };
+
+	pattern_weights() : gamma(codes, 1.0f) {}
+
+	/**
+	 * load the weights saved by save(), or throw std::runtime_error if the file cannot be used
+	 */
+	explicit pattern_weights(const std::string& path) : gamma(codes, 1.0f) {
+		std::ifstream in(path, std::ios::in | std::ios::binary);
+		char magic[8];
+		uint32_t version, count;
+		bool ok = in.read(magic, sizeof(magic)) && std::memcmp(magic, pattern_magic, sizeof(magic)) == 0
+		       && get(in, version) && version == pattern_version && get(in, count);
+		std::vector<float> canon(codes, 1.0f);
+		for (uint32_t i = 0; ok && i < count; i++) {
+			uint16_t code;
+			float weight;
+			ok = get(in, code) && get(in, weight) && weight > 0;
+			if (ok) canon[code] = weight;
+		}
+		if (!ok) throw std::runtime_error("invalid patterns: " + path);
+		for (size_t c = 0; c < codes; c++) gamma[c] = canon[canonical(c)];
+	}
+
+public:
+	/**
+	 * get the weight of playing a move on an empty point for the given side
+	 */
+	float weight(const board& state, int move, unsigned who) const {
+		return gamma[code(state, move, who)];
+	}
+
+	/**
+	 * get the pattern code of a point for the given side, which is kept by the board, see board::pattern()
+	 */
+	static unsigned code(const board& state, int move, unsigned who) {
+		return state.pattern(move, who);
+	}
+
+	/**
+	 * get the pattern codes of all legal moves of the side to move, in the order of their indexes,
+	 * by the variant of the given instruction set, and return the number of legal moves
+	 *
+	 * the 8 neighbors of a point are gathered from a window of each bitboard mask around the point,
+	 * which is a single pext with BMI2, so the codes are the same as code() without any board copy
+	 */
+	static size_t legal_codes(const board& state, uint16_t* codes, isa::level level = isa::selected()) {
+		static size_t (* const variant[isa::levels])(const board&, uint16_t*) = {
+			legal_codes_baseline, legal_codes_sse42, legal_codes_avx2 };
+		return variant[level](state, codes);
+	}
+
+	/**
+	 * get the smallest code of the 8 symmetric shapes of a pattern
+	 */
+	static unsigned canonical(unsigned code) {
+		static const std::vector<uint16_t> table = canonical_table();
+		return table[code];
+	}
+
+	/**
+	 * save the weights of the canonical patterns that differ from 1, return false on failure
+	 */
+	bool save(const std::string& path) const {
+		std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+		std::vector<uint16_t> keep;
+		for (size_t c = 0; c < codes; c++)
+			if (canonical(c) == c && gamma[c] != 1.0f) keep.push_back(c);
+		out.write(pattern_magic, sizeof(pattern_magic));
+		put<uint32_t>(out, pattern_version);
+		put<uint32_t>(out, keep.size());
+		for (uint16_t c : keep) {
+			put<uint16_t>(out, c);
+			put<float>(out, gamma[c]);
+		}
+		return bool(out);
+	}
+
+	/**
+	 * fit the weights to the moves of the valid games of the archives by minorization-maximization,
+	 * i.e., every position is a competition among the patterns of its legal moves and the played one wins
+	 * (Hunter, MM algorithms for generalized Bradley-Terry models, 2004)
+	 *
+	 * each iteration logs the average log-likelihood and the top-1 accuracy of the played moves;
+	 * throw std::runtime_error if an archive cannot be opened
+	 */
+	static pattern_weights train(const std::vector<std::string>& archives, pool& workers,
+			size_t iterations = 20, std::ostream& log = std::cerr) {
+		std::vector<samples> data;
+		for (const std::string& name : archives) {
+			archive games(name);
+			if (!games.is_open()) throw std::runtime_error("cannot open archive: " + name);
+			std::vector<samples> parts;
+			games.verify(workers, parts, [](samples& part, const archive::game& g) {
+				board state;
+				for (size_t i = 0; i < g.ply; i++) {
+					part.add(state, g.moves[i]);
+					state.place(g.moves[i]);
+				}
+			});
+			for (samples& part : parts) data.push_back(std::move(part));
+		}
+
+		std::vector<double> wins(codes, 0);
+		size_t positions = 0;
+		for (const samples& part : data) {
+			for (uint16_t c : part.chosen) wins[c]++;
+			positions += part.chosen.size();
+		}
+		log << "patterns: " << positions << " positions from " << archives.size() << " archives" << std::endl;
+
+		pattern_weights model;
+		std::vector<float>& gamma = model.gamma;
+		size_t lanes = std::max<size_t>(1, std::min(workers.size(), data.size()));
+		for (size_t it = 0; it < iterations && positions; it++) {
+			std::vector<std::vector<double>> denom(lanes, std::vector<double>(codes, 0));
+			std::vector<double> likelihood(lanes, 0);
+			std::vector<double> correct(lanes, 0);
+			workers.parallel(lanes, [&](size_t k) {
+				for (size_t d = k; d < data.size(); d += lanes) {
+					const samples& part = data[d];
+					for (size_t j = 0; j < part.chosen.size(); j++) {
+						double total = 0, best = 0, ties = 0;
+						for (uint32_t i = part.offset[j]; i < part.offset[j + 1]; i++) {
+							double g = gamma[part.codes[i]];
+							total += g * part.counts[i];
+							if (g > best) best = g, ties = 0;
+							if (g == best) ties += part.counts[i];
+						}
+						for (uint32_t i = part.offset[j]; i < part.offset[j + 1]; i++)
+							denom[k][part.codes[i]] += part.counts[i] / total;
+						likelihood[k] += std::log(gamma[part.chosen[j]] / total);
+						if (gamma[part.chosen[j]] == best) correct[k] += 1 / ties; // ties are broken at random
+					}
+				}
+			});
+			for (size_t k = 1; k < lanes; k++) {
+				for (size_t c = 0; c < codes; c++) denom[0][c] += denom[k][c];
+				likelihood[0] += likelihood[k];
+				correct[0] += correct[k];
+			}
+			log << "iteration " << (it + 1) << ": log-likelihood = " << (likelihood[0] / positions)
+			    << ", accuracy = " << (correct[0] * 100.0 / positions) << "%" << std::endl;
+			for (size_t c = 0; c < codes; c++) { // one virtual win and one virtual loss against gamma = 1
+				if (canonical(c) != c || denom[0][c] == 0) continue;
+				gamma[c] = (wins[c] + 1) / (denom[0][c] + 2 / (gamma[c] + 1));
+			}
+		}
+		for (size_t c = 0; c < codes; c++) gamma[c] = gamma[canonical(c)];
+		return model;
+	}
+
+protected:
+	/**
+	 * the training positions of a part of an archive, where position j competes among
+	 * codes[offset[j] ... offset[j + 1]) with their counts, and chosen[j] is the code of the played move
+	 */
+	struct samples {
+		std::vector<uint16_t> codes;
+		std::vector<uint16_t> counts;
+		std::vector<uint32_t> offset = std::vector<uint32_t>(1, 0);
+		std::vector<uint16_t> chosen;
+
+		void add(const board& state, int played) {
+			unsigned who = state.info().who_take_turns;
+			std::array<uint16_t, board::size_x * board::size_y> seen;
+			size_t n = legal_codes(state, seen.data());
+			for (size_t i = 0; i < n; i++) seen[i] = canonical(seen[i]);
+			std::sort(seen.begin(), seen.begin() + n);
+			for (size_t i = 0; i < n; ) {
+				size_t j = i;
+				while (j < n && seen[j] == seen[i]) j++;
+				codes.push_back(seen[i]);
+				counts.push_back(j - i);
+				i = j;
+			}
+			offset.push_back(codes.size());
+			chosen.push_back(canonical(code(state, played, who)));
+		}
+	};
+
+	/**
+	 * the tables to gather the neighbors of a point from the window (m << (size_y + 1)) >> point of a mask m,
+	 * where the neighbor at offset (dx, dy) is the bit dx * size_y + dy + size_y + 1 of the window
+	 */
+	struct gather_table {
+		uint64_t around; // the bits of the 8 neighbors in a window
+		uint8_t border[board::size_x * board::size_y]; // the gathered neighbors that are off the board
+		uint16_t spread[256]; // the code of the gathered neighbors, as if they were own stones
+	};
+	static const gather_table& gathers() {
+		static const gather_table table = []() {
+			gather_table t;
+			int bit[8];
+			t.around = 0;
+			for (int k = 0; k < 8; k++) {
+				bit[k] = offset[k][0] * board::size_y + offset[k][1] + board::size_y + 1;
+				t.around |= uint64_t(1) << bit[k];
+			}
+			auto gathered = [&](int k) { // the index of neighbor k among the gathered bits
+				int j = 0;
+				for (int m = 0; m < 8; m++) j += bit[m] < bit[k];
+				return j;
+			};
+			for (int i = 0; i < board::size_x * board::size_y; i++) {
+				board::point p(i);
+				t.border[i] = 0;
+				for (int k = 0; k < 8; k++) {
+					int x = p.x + offset[k][0], y = p.y + offset[k][1];
+					if (x < 0 || x >= board::size_x || y < 0 || y >= board::size_y) t.border[i] |= 1u << gathered(k);
+				}
+			}
+			for (unsigned b = 0; b < 256; b++) {
+				t.spread[b] = 0;
+				for (int k = 0; k < 8; k++)
+					if (b & (1u << gathered(k))) t.spread[b] |= neighbor::own << (2 * k);
+			}
+			return t;
+		}();
+		return table;
+	}
+
+	struct soft_gather {
+		ISA_INLINE uint64_t operator ()(uint64_t value, uint64_t bits) const {
+			uint64_t gathered = 0;
+			for (uint64_t b = 1; bits; bits &= bits - 1, b <<= 1)
+				if (value & bits & -bits) gathered |= b;
+			return gathered;
+		}
+	};
+#if ISA_X86
+	struct pext_gather {
+		ISA_AVX2 uint64_t operator ()(uint64_t value, uint64_t bits) const { return _pext_u64(value, bits); }
+	};
+#else
+	typedef soft_gather pext_gather;
+#endif
+
+	template<typename gather>
+	ISA_INLINE static size_t extract(const board& state, uint16_t* codes, gather pext) {
+		const gather_table& t = gathers();
+		bitboard b(state);
+		unsigned who = b.who_take_turns();
+		bitboard::mask own = b.of(who) << (board::size_y + 1), opp = b.of(3u - who) << (board::size_y + 1);
+		bitboard::mask hollow = bitboard::hollow() << (board::size_y + 1);
+		size_t n = 0;
+		for (bitboard::mask legal = b.legal(); legal; legal &= legal - 1) {
+			int i = bitboard::first(legal);
+			unsigned edge = t.border[i];
+			unsigned mine = pext(uint64_t(own >> i), t.around) & ~edge;
+			unsigned theirs = pext(uint64_t(opp >> i), t.around) & ~edge;
+			edge |= pext(uint64_t(hollow >> i), t.around);
+			codes[n++] = t.spread[mine] | (t.spread[theirs] << 1) | (t.spread[edge] * neighbor::edge);
+		}
+		return n;
+	}
+	static size_t legal_codes_baseline(const board& state, uint16_t* codes) { return extract(state, codes, soft_gather()); }
+	ISA_SSE42 static size_t legal_codes_sse42(const board& state, uint16_t* codes) { return extract(state, codes, soft_gather()); }
+	ISA_AVX2 static size_t legal_codes_avx2(const board& state, uint16_t* codes) { return extract(state, codes, pext_gather()); }
+
+	static std::vector<uint16_t> canonical_table() {
+		int index[8][8]; // index[s][k]: the neighbor k of a point maps to the neighbor index[s][k] by symmetry s
+		for (int s = 0; s < 8; s++) {
+			for (int k = 0; k < 8; k++) {
+				int x = offset[k][0], y = offset[k][1];
+				if (s & 1) std::swap(x, y);
+				if (s & 2) x = -x;
+				if (s & 4) y = -y;
+				for (int m = 0; m < 8; m++)
+					if (offset[m][0] == x && offset[m][1] == y) index[s][k] = m;
+			}
+		}
+		std::vector<uint16_t> table(codes);
+		for (unsigned code = 0; code < codes; code++) {
+			unsigned best = code;
+			for (int s = 1; s < 8; s++) {
+				unsigned mapped = 0;
+				for (int k = 0; k < 8; k++) mapped |= ((code >> (2 * k)) & 3u) << (2 * index[s][k]);
+				best = std::min(best, mapped);
+			}
+			table[code] = best;
+		}
+		return table;
+	}
+
+	template<typename type> static void put(std::ostream& out, type value) {
+		out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+	template<typename type> static bool get(std::istream& in, type& value) {
+		return bool(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+	}
+
+	static constexpr const int (&offset)[8][2] = board::around_offset;
+	static constexpr char pattern_magic[8] = { 'N', 'O', 'G', 'O', 'P', 'A', 'T', 'T' };
+	static constexpr uint32_t pattern_version = 1;
+
+private:
+	std::vector<float> gamma; // of every code, copied from its canonical code
+};
+
+constexpr char pattern_weights::pattern_magic[8];
+constexpr uint32_t pattern_weights::pattern_version;
@@ -0,0 +1,202 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * pool.h: Shared work-stealing thread pool for running tasks
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/**
+ * work-stealing thread pool
+ *
+ * each worker owns a deque and runs its tasks in FIFO order, so a task that resubmits itself
+ * goes behind the other tasks of the worker; an idle worker steals the newest task of another
+ * worker; tasks submitted from outside the pool are dealt to the workers in turn
+ *
+ * all modes of the program share one pool, see configure() and shared(), so that they never
+ * run more threads than configured by --threads
+ */
+class pool {
+public:
+	typedef std::function<void()> task;
+
+	pool(size_t threads = 0, bool pin = false) : queued(0), turn(0), stopped(false) {
+		if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+		for (size_t i = 0; i < threads; i++)
+			queues.emplace_back(new queue);
+		for (size_t i = 0; i < threads; i++) {
+			workers.emplace_back(&pool::work, this, i);
+			if (pin) bind(workers.back(), i);
+		}
+	}
+	~pool() {
+		{
+			std::lock_guard<std::mutex> lock(sleep);
+			stopped = true;
+		}
+		wakeup.notify_all();
+		for (std::thread& worker : workers) worker.join();
+	}
+
+	/**
+	 * set the size and the core pinning of the shared pool, before its first use
+	 */
+	static void configure(size_t threads, bool pin = false) {
+		settings().threads = threads;
+		settings().pin = pin;
+	}
+
+	/**
+	 * get the pool shared by all modes of the program
+	 */
+	static pool& shared() {
+		static pool instance(settings().threads, settings().pin);
+		return instance;
+	}
+
+public:
+	void submit(task t) {
+		size_t i = (current == this) ? index : (turn++ % queues.size());
+		{
+			std::lock_guard<std::mutex> lock(queues[i]->mtx);
+			queues[i]->tasks.push_back(std::move(t));
+		}
+		{
+			std::lock_guard<std::mutex> lock(sleep);
+			queued++;
+		}
+		wakeup.notify_one();
+	}
+
+	/**
+	 * run fn(0), fn(1), ..., fn(n - 1) in parallel and return after all of them are finished
+	 * the caller runs fn(0) and then helps with the pending tasks, so it is safe to call this
+	 * from a task of the same pool
+	 */
+	void parallel(size_t n, const std::function<void(size_t)>& fn) {
+		std::atomic<size_t> left(n);
+		for (size_t i = 1; i < n; i++)
+			submit([&fn, &left, i]() { fn(i); left--; });
+		if (n) {
+			fn(0);
+			left--;
+		}
+		while (left) {
+			if (!run_one()) std::this_thread::yield();
+		}
+	}
+
+	/**
+	 * run fn(0), fn(1), ..., fn(n - 1) as a group and return after all of them are finished
+	 * unlike parallel(), the caller runs only the calls of this group, and then waits for those taken by
+	 * the workers, so it is never held up by an unrelated task, e.g., a slice of another server session;
+	 * every worker that takes a helper of the group runs the calls not taken yet, and a helper that
+	 * starts after all of them are taken returns at once
+	 */
+	void group(size_t n, const std::function<void(size_t)>& fn) {
+		struct state {
+			std::atomic<size_t> next, done;
+			state() : next(0), done(0) {}
+		};
+		std::shared_ptr<state> g(new state); // shared with the helpers, which may start after this returns
+		const std::function<void(size_t)>* call = &fn; // only used while some call is not finished
+		auto take = [g, call, n]() {
+			for (size_t i; (i = g->next++) < n; g->done++) (*call)(i);
+		};
+		for (size_t i = 1; i < std::min(n, size() + 1); i++) submit(take);
+		take();
+		while (g->done < n) std::this_thread::yield();
+	}
+
+	size_t size() const { return workers.size(); }
+
+protected:
+	struct queue {
+		std::mutex mtx;
+		std::deque<task> tasks;
+	};
+	struct config {
+		size_t threads = 0;
+		bool pin = false;
+	};
+	static config& settings() { static config conf; return conf; }
+
+	void work(size_t i) {
+		current = this;
+		index = i;
+		while (true) {
+			if (run_one()) continue;
+			std::unique_lock<std::mutex> lock(sleep);
+			wakeup.wait(lock, [this]() { return stopped || queued; });
+			if (stopped && !queued) return;
+		}
+	}
+
+	/**
+	 * run a task of the own deque, or steal one from the others
+	 * return false if there is no task to run
+	 */
+	bool run_one() {
+		size_t self = (current == this) ? index : 0;
+		task t;
+		for (size_t k = 0; k < queues.size() && !t; k++) {
+			queue& q = *queues[(self + k) % queues.size()];
+			std::lock_guard<std::mutex> lock(q.mtx);
+			if (q.tasks.empty()) continue;
+			if (k == 0) {
+				t = std::move(q.tasks.front());
+				q.tasks.pop_front();
+			} else {
+				t = std::move(q.tasks.back());
+				q.tasks.pop_back();
+			}
+		}
+		if (!t) return false;
+		{
+			std::lock_guard<std::mutex> lock(sleep);
+			queued--;
+		}
+		t();
+		return true;
+	}
+
+	static void bind(std::thread& worker, size_t i) {
+#ifdef __linux__
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(i % std::max(1u, std::thread::hardware_concurrency()), &cpus);
+		pthread_setaffinity_np(worker.native_handle(), sizeof(cpus), &cpus);
+#endif
+	}
+
+private:
+	std::vector<std::unique_ptr<queue>> queues;
+	std::vector<std::thread> workers;
+	size_t queued; // guarded by sleep
+	std::atomic<size_t> turn;
+	bool stopped;
+	std::mutex sleep;
+	std::condition_variable wakeup;
+
+	static thread_local pool* current;
+	static thread_local size_t index;
+};
+
+thread_local pool* pool::current = nullptr;
+thread_local size_t pool::index = 0;
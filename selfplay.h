@@ -0,0 +1,355 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * selfplay.h: Distributed self-play with a coordinator and worker processes
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <poll.h>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+#include "episode.h"
+#include "statistic.h"
+#include "pool.h"
+#include "socket.h"
+
+/**
+ * the messages between the coordinator and the workers
+ *
+ * a message is framed as a 32-bit length of the rest, a type, and the payload, where all integers are
+ * little-endian regardless of the host, so that the processes may run on different machines:
+ *  hello (worker): the number of threads of the worker
+ *  batch (coordinator): the batch id, the number of games, the seed, the black and the white arguments
+ *  result (worker): the batch id and an episode packed by episode::pack()
+ *  done (worker): the batch id, after all its results
+ *  quit (coordinator): no more batches
+ */
+struct wire {
+	enum type : uint8_t { hello = 1, batch = 2, result = 3, done = 4, quit = 5 };
+
+	static std::string frame(type t, const std::string& payload = "") {
+		std::string msg;
+		put<uint32_t>(msg, payload.size() + 1);
+		msg.push_back(char(t));
+		return msg + payload;
+	}
+
+	/**
+	 * take a whole message from the front of the buffer, return false if it is not complete yet
+	 */
+	static bool take(std::string& buf, type& t, std::string& payload) {
+		if (buf.size() < 5) return false;
+		const char* p = buf.data();
+		uint32_t len = get<uint32_t>(p);
+		if (buf.size() < 4 + size_t(len)) return false;
+		t = type(buf[4]);
+		payload.assign(buf, 5, len - 1);
+		buf.erase(0, 4 + len);
+		return true;
+	}
+
+	/**
+	 * read a whole message from a blocking socket, return false if the connection is lost
+	 */
+	static bool read(int fd, type& t, std::string& payload) {
+		char head[5];
+		if (!tcp::recv_all(fd, head, sizeof(head))) return false;
+		const char* p = head;
+		uint32_t len = get<uint32_t>(p);
+		if (len == 0) return false;
+		t = type(head[4]);
+		payload.resize(len - 1);
+		return tcp::recv_all(fd, &payload[0], payload.size());
+	}
+
+	template<typename value> static void put(std::string& out, value v) {
+		for (size_t i = 0; i < sizeof(v); i++) out.push_back(char(uint64_t(v) >> (8 * i)));
+	}
+	template<typename value> static value get(const char*& p) {
+		uint64_t v = 0;
+		for (size_t i = 0; i < sizeof(value); i++) v |= uint64_t(uint8_t(*p++)) << (8 * i);
+		return value(v);
+	}
+	static void put_string(std::string& out, const std::string& s) {
+		put<uint32_t>(out, s.size());
+		out += s;
+	}
+	static bool get_string(const char*& p, const char* end, std::string& s) {
+		if (end - p < 4) return false;
+		uint32_t len = get<uint32_t>(p);
+		if (size_t(end - p) < len) return false;
+		s.assign(p, len);
+		p += len;
+		return true;
+	}
+};
+
+/**
+ * coordinator of the distributed self-play, which records the games of the workers into the statistic
+ *
+ * the remaining games of the statistic are split into batches, and every worker holds at most two
+ * batches at a time, so that it never waits for the next one; when a worker is lost, the games of its
+ * batches that have not been reported are put back as a new batch for the other workers
+ *
+ * a worker is also lost if it holds batches but sends nothing for timeout seconds, e.g., if it hangs
+ * without closing its connection, so the timeout should be longer than a game of the workers
+ */
+class coordinator {
+public:
+	coordinator(unsigned port, bool loopback, statistic& stat,
+			const std::string& black_args, const std::string& white_args, size_t batch, double timeout = 600)
+		: port(port), loopback(loopback), stat(stat), black_args(black_args), white_args(white_args),
+		  batch(std::max<size_t>(1, batch)), timeout(timeout), next_id(0) {}
+
+	/**
+	 * serve the workers until all games are recorded, or return a non-zero code if the port cannot be bound
+	 */
+	int run() {
+		int listener = tcp::listen_on(port, loopback);
+		if (listener < 0) {
+			std::cerr << "cannot listen on port " << port << std::endl;
+			return 1;
+		}
+		std::cerr << "coordinator listening on " << (loopback ? "127.0.0.1" : "0.0.0.0") << ":" << port << std::endl;
+
+		size_t left = stat.remaining();
+		for (size_t n = left; n; n -= std::min(n, batch)) queue(std::min(n, batch));
+
+		std::vector<std::unique_ptr<peer>> peers;
+		std::vector<pollfd> fds;
+		char buf[65536];
+		while (left) {
+			fds.assign(1, { listener, POLLIN, 0 });
+			for (auto& w : peers) fds.push_back({ w->fd, POLLIN, 0 });
+			if (::poll(fds.data(), fds.size(), 100) < 0) continue;
+
+			for (size_t i = 1; i < fds.size(); i++) {
+				if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+				peer& w = *peers[i - 1];
+				ssize_t n = ::recv(w.fd, buf, sizeof(buf), 0);
+				if (n <= 0) {
+					w.lost = true;
+					continue;
+				}
+				w.heard = std::chrono::steady_clock::now();
+				w.input.append(buf, n);
+				wire::type t;
+				std::string payload;
+				while (!w.lost && wire::take(w.input, t, payload)) w.lost = !handle(w, t, payload, left);
+			}
+
+			if (fds[0].revents & POLLIN) {
+				int fd = tcp::accept_from(listener);
+				if (fd >= 0) peers.emplace_back(new peer(fd));
+			}
+
+			auto now = std::chrono::steady_clock::now();
+			for (auto& w : peers) {
+				if (!w->lost && w->jobs.size() && now - w->heard > std::chrono::duration<double>(timeout)) {
+					std::cerr << "worker " << w->fd << " timed out" << std::endl;
+					w->lost = true;
+				}
+				if (w->lost) {
+					std::cerr << "worker " << w->fd << " lost, " << w->jobs.size() << " batches requeued" << std::endl;
+					for (const job& j : w->jobs)
+						if (j.received < j.games) queue(j.games - j.received);
+					::close(w->fd);
+					continue;
+				}
+				while (w->threads && w->jobs.size() < 2 && pending.size()) {
+					job j = pending.front();
+					std::string payload;
+					wire::put<uint32_t>(payload, j.id);
+					wire::put<uint32_t>(payload, j.games);
+					wire::put<uint32_t>(payload, j.seed);
+					wire::put_string(payload, black_args);
+					wire::put_string(payload, white_args);
+					std::string msg = wire::frame(wire::batch, payload);
+					if (!tcp::send_all(w->fd, msg.data(), msg.size())) break; // found lost at the next poll
+					if (w->jobs.empty()) w->heard = now; // the timeout runs only while the worker holds batches
+					w->jobs.push_back(j);
+					pending.pop_front();
+				}
+			}
+			peers.erase(std::remove_if(peers.begin(), peers.end(),
+				[](std::unique_ptr<peer>& w) { return w->lost; }), peers.end());
+		}
+
+		std::string msg = wire::frame(wire::quit);
+		for (auto& w : peers) {
+			tcp::send_all(w->fd, msg.data(), msg.size());
+			::close(w->fd);
+		}
+		::close(listener);
+		return 0;
+	}
+
+protected:
+	struct job {
+		uint32_t id;
+		uint32_t games;
+		uint32_t seed;
+		uint32_t received;
+	};
+	struct peer {
+		peer(int fd) : fd(fd), heard(std::chrono::steady_clock::now()) {}
+		int fd;
+		uint32_t threads = 0; // known after hello
+		bool lost = false;
+		std::chrono::steady_clock::time_point heard; // the last time anything was received
+		std::string input;
+		std::vector<job> jobs;
+	};
+
+	void queue(size_t games) {
+		uint32_t id = next_id++;
+		pending.push_back({ id, uint32_t(games), id * 1024 + 1, 0 }); // the threads of a worker take seed + k
+	}
+
+	/**
+	 * handle a message of a worker, return false if the worker is broken
+	 */
+	bool handle(peer& w, wire::type t, const std::string& payload, size_t& left) {
+		const char* p = payload.data();
+		const char* end = p + payload.size();
+		if (t == wire::hello && payload.size() == 4) {
+			w.threads = std::max<uint32_t>(1, wire::get<uint32_t>(p));
+			return true;
+		}
+		if ((t != wire::result && t != wire::done) || payload.size() < 4) return false;
+		uint32_t id = wire::get<uint32_t>(p);
+		auto it = std::find_if(w.jobs.begin(), w.jobs.end(), [=](const job& j) { return j.id == id; });
+		if (it == w.jobs.end()) return false;
+		if (t == wire::done) {
+			if (it->received < it->games) queue(it->games - it->received);
+			w.jobs.erase(it);
+			return true;
+		}
+		episode game;
+		if (!game.unpack(p, end) || p != end || it->received >= it->games) return false;
+		it->received++;
+		if (left) {
+			stat.append(game);
+			left--;
+		}
+		return true;
+	}
+
+private:
+	unsigned port;
+	bool loopback;
+	statistic& stat;
+	std::string black_args;
+	std::string white_args;
+	size_t batch;
+	double timeout; // in seconds, of a worker holding batches
+	uint32_t next_id;
+	std::deque<job> pending;
+};
+
+/**
+ * worker of the distributed self-play, which plays the batches of a coordinator on its pool
+ */
+class worker {
+public:
+	worker(const std::string& host, unsigned port, pool& workers) : host(host), port(port), workers(workers) {}
+
+	/**
+	 * play batches until the coordinator quits, or return a non-zero code if the connection is lost
+	 */
+	int run() {
+		int fd = -1;
+		for (int retry = 0; retry < 50 && (fd = tcp::connect_to(host, port)) < 0; retry++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		if (fd < 0) {
+			std::cerr << "cannot connect to " << host << ":" << port << std::endl;
+			return 1;
+		}
+		std::string hello;
+		wire::put<uint32_t>(hello, workers.size());
+		hello = wire::frame(wire::hello, hello);
+		bool ok = tcp::send_all(fd, hello.data(), hello.size());
+
+		wire::type t;
+		std::string payload;
+		while (ok && wire::read(fd, t, payload)) {
+			if (t == wire::quit) {
+				::close(fd);
+				return 0;
+			}
+			ok = (t == wire::batch) && play(fd, payload);
+		}
+		std::cerr << "connection to " << host << ":" << port << " lost" << std::endl;
+		::close(fd);
+		return 1;
+	}
+
+protected:
+	/**
+	 * play a batch, and report every game as soon as it is finished
+	 */
+	bool play(int fd, const std::string& payload) {
+		const char* p = payload.data();
+		const char* end = p + payload.size();
+		if (payload.size() < 12) return false;
+		uint32_t id = wire::get<uint32_t>(p), games = wire::get<uint32_t>(p), seed = wire::get<uint32_t>(p);
+		std::string black_args, white_args;
+		if (!wire::get_string(p, end, black_args) || !wire::get_string(p, end, white_args)) return false;
+
+		std::mutex mtx;
+		std::atomic<long> left(games);
+		std::atomic<bool> ok(true);
+		workers.parallel(std::min<size_t>(workers.size(), games), [&](size_t k) {
+			std::string seeded = " seed=" + std::to_string(seed + k);
+			player black("name=black N=7000 " + black_args + seeded + " role=black");
+			player white("name=white N=7000 " + white_args + seeded + " role=white");
+			while (ok && left.fetch_sub(1) > 0) {
+				black.open_episode("~:" + white.name());
+				white.open_episode(black.name() + ":~");
+				episode game;
+				game.open_episode(black.name() + ":" + white.name());
+				while (true) {
+					agent& who = game.take_turns(black, white);
+					action move = who.take_action(game.state());
+					if (game.apply_action(move) != true) break;
+					if (who.check_for_win(game.state())) break;
+				}
+				agent& win = game.last_turns(black, white);
+				game.close_episode(win.name());
+				black.close_episode(win.name());
+				white.close_episode(win.name());
+
+				std::string record;
+				wire::put<uint32_t>(record, id);
+				game.pack(record);
+				record = wire::frame(wire::result, record);
+				std::lock_guard<std::mutex> lock(mtx);
+				if (!tcp::send_all(fd, record.data(), record.size())) ok = false;
+			}
+		});
+		std::string done;
+		wire::put<uint32_t>(done, id);
+		done = wire::frame(wire::done, done);
+		return ok && tcp::send_all(fd, done.data(), done.size());
+	}
+
+private:
+	std::string host;
+	unsigned port;
+	pool& workers;
+};
@@ -0,0 +1,158 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * server.h: TCP GTP server with concurrent sessions
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <iostream>
+#include <poll.h>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+#include "episode.h"
+#include "statistic.h"
+#include "gtp.h"
+#include "pool.h"
+#include "socket.h"
+
+/**
+ * GTP server where each connection is a session with its own game state and players
+ *
+ * a single thread polls the sockets and splits the input into commands,
+ * and the commands are executed by the shared workers, one command per task;
+ * a session with more pending commands resubmits itself behind the other sessions,
+ * so that every session gets a fair share of the workers
+ *
+ * an analysis (nogo-analyze N) is searched in slices of a few cycles, one slice per task, so that
+ * a few workers can serve many analyses at once, each with its own budget of N cycles
+ *
+ * save_tree and load_tree are not available to the clients, since they would reach any path of the server
+ */
+class server {
+public:
+	server(unsigned port, const std::string& black_args, const std::string& white_args,
+			const std::string& name, const std::string& version, pool& workers, size_t slice = 256)
+		: port(port), black_args(black_args), white_args(white_args), name(name), version(version),
+		  workers(workers), slice(slice) {}
+
+	/**
+	 * serve forever, or return a non-zero code if the port cannot be bound
+	 */
+	int run() {
+		int listener = tcp::listen_on(port);
+		if (listener < 0) {
+			std::cerr << "cannot listen on port " << port << std::endl;
+			return 1;
+		}
+		std::cerr << "GTP server listening on 127.0.0.1:" << port << std::endl;
+
+		std::vector<std::shared_ptr<session>> sessions;
+		std::vector<pollfd> fds;
+		char buf[4096];
+		while (true) {
+			fds.assign(1, { listener, POLLIN, 0 });
+			for (auto& s : sessions) fds.push_back({ s->hangup ? -1 : s->fd, POLLIN, 0 });
+			if (::poll(fds.data(), fds.size(), 50) < 0) continue;
+
+			for (size_t i = 1; i < fds.size(); i++) {
+				if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+				session& s = *sessions[i - 1];
+				ssize_t n = ::recv(s.fd, buf, sizeof(buf), 0);
+				std::lock_guard<std::mutex> lock(s.mtx);
+				if (n <= 0) {
+					s.hangup = true;
+					continue;
+				}
+				s.input.append(buf, n);
+				for (size_t eol; (eol = s.input.find('\n')) != std::string::npos; s.input.erase(0, eol + 1))
+					s.lines.emplace_back(s.input, 0, eol);
+				if (!s.busy && s.lines.size()) {
+					s.busy = true;
+					schedule(sessions[i - 1]);
+				}
+			}
+
+			if (fds[0].revents & POLLIN) {
+				int fd = tcp::accept_from(listener);
+				if (fd >= 0) sessions.emplace_back(new session(fd, *this));
+			}
+
+			sessions.erase(std::remove_if(sessions.begin(), sessions.end(), [](std::shared_ptr<session>& s) {
+				std::lock_guard<std::mutex> lock(s->mtx);
+				if (s->busy) return false;
+				if (!s->broken && !s->shell.is_closed() && !(s->hangup && s->lines.empty())) return false;
+				s->shell.close();
+				::close(s->fd);
+				return true;
+			}), sessions.end());
+		}
+	}
+
+protected:
+	struct session {
+		session(int fd, const server& host) : fd(fd),
+			stat(-1ull, -1ull, 1),
+			black("name=black N=7000 " + host.black_args + " role=black"),
+			white("name=white N=7000 " + host.white_args + " role=white"),
+			shell(stat, black, white, host.name, host.version) {
+			stat.redirect(std::cerr);
+			shell.slice(host.slice);
+			shell.allow_files(false); // a client must not read or write the files of the server
+		}
+
+		int fd;
+		statistic stat;
+		player black;
+		player white;
+		gtp shell;
+
+		std::mutex mtx; // guards the fields below
+		std::string input;
+		std::deque<std::string> lines;
+		bool busy = false;
+		bool hangup = false;
+		bool broken = false;
+	};
+
+	/**
+	 * execute the next command of the session, or the next slice of its pending command, on a worker
+	 */
+	void schedule(std::shared_ptr<session> s) {
+		workers.submit([this, s]() {
+			std::string line;
+			if (!s->shell.is_pending()) {
+				std::lock_guard<std::mutex> lock(s->mtx);
+				line.swap(s->lines.front());
+				s->lines.pop_front();
+			}
+			const std::string& res = s->shell.is_pending() ? s->shell.resume() : s->shell.execute(line.data(), line.size());
+			bool sent = res.empty() || tcp::send_all(s->fd, res.data(), res.size());
+
+			std::lock_guard<std::mutex> lock(s->mtx);
+			s->broken |= !sent;
+			if ((s->lines.size() || s->shell.is_pending()) && !s->broken && !s->shell.is_closed()) {
+				schedule(s);
+			} else {
+				s->busy = false;
+			}
+		});
+	}
+
+private:
+	unsigned port;
+	std::string black_args;
+	std::string white_args;
+	std::string name;
+	std::string version;
+	pool& workers;
+	size_t slice; // cycles of an analysis per task
+};
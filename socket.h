@@ -0,0 +1,105 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * socket.h: Minimal TCP helpers for the network modes
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <cstring>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+namespace tcp {
+
+/**
+ * listen on the given port, on the loopback interface only unless loopback is false
+ * return the listening socket, or -1 on failure
+ */
+inline int listen_on(unsigned port, bool loopback = true, int backlog = 64) {
+	int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) return -1;
+	int on = 1;
+	::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	sockaddr_in addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(loopback ? INADDR_LOOPBACK : INADDR_ANY);
+	if (::bind(fd, (sockaddr*) &addr, sizeof(addr)) < 0 || ::listen(fd, backlog) < 0) {
+		::close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * accept a connection with Nagle's algorithm disabled, or return -1
+ */
+inline int accept_from(int server) {
+	int fd = ::accept(server, nullptr, nullptr);
+	if (fd < 0) return -1;
+	int on = 1;
+	::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	return fd;
+}
+
+/**
+ * connect to a host by name or address with Nagle's algorithm disabled, or return -1
+ */
+inline int connect_to(const std::string& host, unsigned port) {
+	addrinfo hints, *found = nullptr;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found) != 0) return -1;
+	int fd = -1;
+	for (addrinfo* ai = found; ai && fd < 0; ai = ai->ai_next) {
+		fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd >= 0 && ::connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+			::close(fd);
+			fd = -1;
+		}
+	}
+	::freeaddrinfo(found);
+	if (fd < 0) return -1;
+	int on = 1;
+	::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	return fd;
+}
+
+/**
+ * receive exactly len bytes, return false if the connection is closed or broken
+ */
+inline bool recv_all(int fd, char* data, size_t len) {
+	while (len) {
+		ssize_t n = ::recv(fd, data, len, 0);
+		if (n <= 0) return false;
+		data += n;
+		len -= n;
+	}
+	return true;
+}
+
+/**
+ * send the whole buffer, return false if the connection is broken
+ */
+inline bool send_all(int fd, const char* data, size_t len) {
+	while (len) {
+		ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL);
+		if (n <= 0) return false;
+		data += n;
+		len -= n;
+	}
+	return true;
+}
+
+} // namespace tcp
@@ -0,0 +1,76 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * solver.h: Exact endgame analysis for small positions
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include "board.h"
+
+/**
+ * negamax solver with a transposition table
+ * the search gives up once it has visited more positions than the budget
+ */
+class solver {
+public:
+	enum result { unknown = -1, lose = 0, win = 1 };
+
+	solver(size_t budget = 100000) : budget(budget), visited(0) {}
+
+	/**
+	 * solve the position for the side to move
+	 * return result::win or result::lose if it is proven, or result::unknown if the budget runs out
+	 */
+	result solve(const board& state) {
+		visited = 0;
+		table.clear();
+		return negamax(state);
+	}
+
+	/**
+	 * count the empty points (not the hollow ones), whether or not either side can still play them
+	 */
+	static size_t empties(const board& state) {
+		size_t n = 0;
+		for (int x = 0; x < board::size_x; x++)
+			for (int y = 0; y < board::size_y; y++)
+				if (state[x][y] == board::empty) n++;
+		return n;
+	}
+
+protected:
+	result negamax(const board& state) {
+		std::string key = encode(state);
+		auto it = table.find(key);
+		if (it != table.end()) return it->second;
+		if (++visited > budget) return result::unknown;
+
+		result res = result::lose; // no legal move, or every move loses
+		for (int move = 0; move < board::size_x * board::size_y && res != result::win; move++) {
+			board after = state;
+			if (after.place(move) != board::legal) continue;
+			result opp = negamax(after);
+			if (opp == result::lose) res = result::win;
+			else if (opp == result::unknown) res = result::unknown;
+		}
+		if (res != result::unknown) table[key] = res;
+		return res;
+	}
+
+	static std::string encode(const board& state) {
+		std::string key(board::size_x * board::size_y + 1, char(state.info().who_take_turns));
+		for (int i = 0; i < board::size_x * board::size_y; i++) key[i] = char(state(i));
+		return key;
+	}
+
+private:
+	size_t budget;
+	size_t visited;
+	std::unordered_map<std::string, result> table;
+};
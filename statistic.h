@@ -12,6 +12,8 @@
 #include <algorithm>
 #include <iostream>
 #include <sstream>
+#include <iomanip>
+#include <vector>
 #include "board.h"
 #include "action.h"
 #include "agent.h"
@@ -30,7 +32,13 @@ public:
 		: total(total),
 		  block(block ? block : total),
 		  limit(limit ? limit : total),
-		  count(0) {}
+		  count(0),
+		  report(&std::cout) {}
+
+	/**
+	 * redirect the statistic reports, e.g., to std::cerr when stdout is used by the GTP shell
+	 */
+	void redirect(std::ostream& out) { report = &out; }
 
 public:
 	/**
@@ -67,29 +75,77 @@ public:
 			Wdu += ep.time(action::white::type);
 		}
 
-		std::cout << count << "\t";
-		std::cout << "win = " << (BW * 100.0 / blk) << "%"
+		(*report) << count << "\t";
+		(*report) << "win = " << (BW * 100.0 / blk) << "%"
 		          <<      "|" << (WW * 100.0 / blk) << "%, ";
-		std::cout << "op = "  << (sop * 1.0 / blk)
+		(*report) << "op = "  << (sop * 1.0 / blk)
 		          <<     " (" << (Bop * 1.0 / blk)
 		          <<      "|" << (Wop * 1.0 / blk) << "), ";
-		std::cout << "ops = " << (sop * 1000.0 / sdu)
+		(*report) << "ops = " << (sop * 1000.0 / sdu)
 		          <<     " (" << (Bop * 1000.0 / Bdu)
 		          <<      "|" << (Wop * 1000.0 / Wdu) << ")";
-		std::cout << std::endl;
+		(*report) << std::endl;
 	}
 
-	void summary() const {
+	void summary(double limit = 0) const {
 		auto block_temp = block;
 		const_cast<statistic&>(*this).block = data.size();
 		show();
 		const_cast<statistic&>(*this).block = block_temp;
+		latency(limit);
+	}
+
+	/**
+	 * show the tail latency of the moves of all games, per color and per game phase
+	 *
+	 * the format would be
+	 * black  opening  p50 = 12.345, p90 = 20.1, p99 = 35.7, max = 41.2 (n = 1000, 3 near limit)
+	 *
+	 * where
+	 *  'black  opening': the moves of black in the opening, i.e., the first 20 moves of a game;
+	 *                    the middle game is move 21 ~ 40, and the endgame is the rest
+	 *  'p50 = 12.345, ...': the percentiles and the maximum of the move latency in milliseconds
+	 *  'n = 1000': the number of moves
+	 *  '3 near limit': the number of moves taking at least 90% of the limit (in milliseconds),
+	 *                  which is shown only if the limit is given
+	 */
+	void latency(double limit = 0) const {
+		const char* color[] = { "black", "white" };
+		const char* phase[] = { "all", "opening", "middle", "endgame" };
+		std::vector<time_t> lat[2][4];
+		for (const episode& ep : data) {
+			for (size_t i = 0; i < ep.ep_moves.size(); i++) {
+				time_t t = ep.ep_moves[i].time;
+				lat[i % 2][0].push_back(t);
+				lat[i % 2][i < 20 ? 1 : i < 40 ? 2 : 3].push_back(t);
+			}
+		}
+		for (int c = 0; c < 2; c++) {
+			for (int p = 0; p < 4; p++) {
+				std::vector<time_t>& v = lat[c][p];
+				if (v.empty()) continue;
+				std::sort(v.begin(), v.end());
+				auto pct = [&](double q) { return v[std::min(v.size() - 1, size_t(q * v.size()))] / 1000.0; };
+				(*report) << std::left << std::setw(7) << color[c] << std::setw(9) << phase[p] << std::right;
+				(*report) << "p50 = " << pct(0.5) << ", p90 = " << pct(0.9) << ", p99 = " << pct(0.99)
+				          << ", max = " << (v.back() / 1000.0) << " (n = " << v.size();
+				if (limit > 0) {
+					size_t near = v.end() - std::lower_bound(v.begin(), v.end(), time_t(limit * 900));
+					(*report) << ", " << near << " near limit";
+				}
+				(*report) << ")" << std::endl;
+			}
+		}
 	}
 
 	bool is_finished() const {
 		return count >= total;
 	}
 
+	size_t remaining() const {
+		return total > count ? total - count : 0;
+	}
+
 	bool is_episode_ongoing() const {
 		return data.size() && data.back().ep_close.when == 0;
 	}
@@ -105,6 +161,15 @@ public:
 		if (count % block == 0) show();
 	}
 
+	/**
+	 * add a finished episode, e.g., one played by another thread
+	 */
+	void append(const episode& ep) {
+		if (count++ >= limit) data.pop_front();
+		data.push_back(ep);
+		if (count % block == 0) show();
+	}
+
 	episode& at(size_t i) {
 		auto it = data.begin();
 		while (i--) it++;
@@ -136,5 +201,6 @@ private:
 	size_t block;
 	size_t limit;
 	size_t count;
+	std::ostream* report;
 	std::list<episode> data;
 };
@@ -0,0 +1,181 @@
+/**
+ * Framework for NoGo and similar games (C++ 11)
+ * tuner.h: SPSA tuning of the numeric arguments of a player
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <atomic>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+#include "episode.h"
+#include "pool.h"
+
+/**
+ * simultaneous perturbation stochastic approximation over player arguments
+ *
+ * the parameters are tuned in their normalized ranges [0, 1]; every iteration perturbs all of them
+ * at once by +-c_k, plays a match between the two perturbed players in parallel, where each plays
+ * both colors equally, and moves the parameters along the perturbation by a_k times the score
+ * (Spall, 1998, with the usual gains a_k = a / (k + 1 + A)^0.602 and c_k = c / (k + 1)^0.101)
+ *
+ * the parameters are saved to the checkpoint after every iteration, from which a later run resumes
+ */
+class tuner {
+public:
+	/**
+	 * the spec lists the parameters as name=start:min:max, e.g., "explore=1.4:0.2:3 bias=1:0:4",
+	 * and the base arguments are given to both players; throw std::invalid_argument if the spec is wrong
+	 */
+	tuner(const std::string& spec, const std::string& base, size_t games, pool& workers)
+		: base(base), games(std::max<size_t>(2, games + games % 2)), workers(workers), done(0) {
+		std::stringstream ss(spec);
+		for (std::string item; ss >> item; ) {
+			param p;
+			char sep[3] = {};
+			std::stringstream range(item.substr(item.find('=') + 1));
+			p.name = item.substr(0, item.find('='));
+			if (item.find('=') == std::string::npos || !(range >> p.value >> sep[0] >> p.min >> sep[1] >> p.max)
+					|| sep[0] != ':' || sep[1] != ':' || !(p.min < p.max))
+				throw std::invalid_argument("invalid tuning parameter: " + item);
+			p.value = std::min(std::max(p.value, p.min), p.max);
+			params.push_back(p);
+		}
+		if (params.empty()) throw std::invalid_argument("no tuning parameter: " + spec);
+	}
+
+public:
+	/**
+	 * run until the given number of iterations are done, including those of the checkpoint
+	 */
+	void run(size_t iterations, const std::string& checkpoint = "", std::ostream& log = std::cout) {
+		if (checkpoint.size() && resume(checkpoint))
+			log << "resume from iteration " << done << ": " << args() << std::endl;
+		double A = 0.1 * iterations;
+		for (; done < iterations; done++) {
+			double ck = c / std::pow(done + 1.0, 0.101);
+			double ak = a / std::pow(done + 1.0 + A, 0.602);
+			std::default_random_engine engine(done + 1); // the perturbation only depends on the iteration
+			std::vector<int> delta(params.size());
+			std::string plus, minus;
+			for (size_t i = 0; i < params.size(); i++) {
+				delta[i] = (engine() & 1) ? 1 : -1;
+				plus += " " + params[i].name + "=" + std::to_string(denormalize(i, normalize(i) + ck * delta[i]));
+				minus += " " + params[i].name + "=" + std::to_string(denormalize(i, normalize(i) - ck * delta[i]));
+			}
+			double score = match(plus, minus, done * games);
+			for (size_t i = 0; i < params.size(); i++)
+				params[i].value = denormalize(i, normalize(i) + ak * score / (2 * ck) * delta[i]);
+
+			log << "iteration " << (done + 1) << ": score = " << score << ", " << args() << std::endl;
+			if (checkpoint.size()) save(checkpoint, done + 1);
+		}
+	}
+
+	/**
+	 * get the current parameters as player arguments
+	 */
+	std::string args() const {
+		std::string res;
+		for (const param& p : params) res += (res.size() ? " " : "") + p.name + "=" + std::to_string(p.value);
+		return res;
+	}
+
+protected:
+	struct param {
+		std::string name;
+		double value, min, max;
+	};
+
+	double normalize(size_t i) const {
+		return (params[i].value - params[i].min) / (params[i].max - params[i].min);
+	}
+	double denormalize(size_t i, double x) const {
+		x = std::min(std::max(x, 0.0), 1.0);
+		return params[i].min + x * (params[i].max - params[i].min);
+	}
+
+	/**
+	 * play the perturbed players against each other, and get the score of plus in [-1, 1]
+	 * game g is played with seed first + g, and plus plays black in the even games
+	 */
+	double match(const std::string& plus, const std::string& minus, size_t first) {
+		std::atomic<int> score(0);
+		workers.parallel(games, [&](size_t g) {
+			std::string seed = " seed=" + std::to_string(first + g);
+			bool swap = g % 2;
+			player black("name=" + std::string(swap ? "minus" : "plus") + " N=7000 " + base + (swap ? minus : plus) + seed + " role=black");
+			player white("name=" + std::string(swap ? "plus" : "minus") + " N=7000 " + base + (swap ? plus : minus) + seed + " role=white");
+			bool black_won = play(black, white);
+			score += (black_won != swap) ? 1 : -1;
+		});
+		return double(score) / games;
+	}
+
+	/**
+	 * play a game and return whether black won
+	 */
+	static bool play(player& black, player& white) {
+		black.open_episode("~:" + white.name());
+		white.open_episode(black.name() + ":~");
+		episode game;
+		game.open_episode(black.name() + ":" + white.name());
+		while (true) {
+			agent& who = game.take_turns(black, white);
+			action move = who.take_action(game.state());
+			if (game.apply_action(move) != true) break;
+			if (who.check_for_win(game.state())) break;
+		}
+		agent& win = game.last_turns(black, white);
+		game.close_episode(win.name());
+		black.close_episode(win.name());
+		white.close_episode(win.name());
+		return &win == &black;
+	}
+
+	/**
+	 * the checkpoint is a line of "iteration=K" followed by the parameters, e.g., "iteration=12 explore=1.3 bias=0.8"
+	 */
+	void save(const std::string& path, size_t iteration) const {
+		std::ofstream out(path, std::ios::out | std::ios::trunc);
+		out << "iteration=" << iteration << " " << args() << std::endl;
+	}
+	bool resume(const std::string& path) {
+		std::ifstream in(path, std::ios::in);
+		std::string item;
+		if (!(in >> item) || item.find("iteration=") != 0) return false;
+		done = std::stoull(item.substr(item.find('=') + 1));
+		while (in >> item) {
+			for (param& p : params)
+				if (item.substr(0, item.find('=')) == p.name)
+					p.value = std::min(std::max(std::stod(item.substr(item.find('=') + 1)), p.min), p.max);
+		}
+		return true;
+	}
+
+	static constexpr double a = 0.05; // the step gain, in the normalized ranges
+	static constexpr double c = 0.1; // the first perturbations are 10% of the ranges
+
+private:
+	std::vector<param> params;
+	std::string base;
+	size_t games;
+	pool& workers;
+	size_t done;
+};
+
+constexpr double tuner::a;
+constexpr double tuner::c;